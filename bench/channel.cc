@@ -0,0 +1,101 @@
+/* Measures message throughput of ostd::channel and ostd::bounded_channel.
+ *
+ * A number of producer threads put small messages into a channel and the
+ * same number of consumer threads get them out; the best of a few runs
+ * is reported in millions of messages per second.
+ *
+ * Then two threads pass a message back and forth through a pair of
+ * channels, so that every get has to wait for the other thread; the best
+ * average time of a single handoff is reported in nanoseconds, with the
+ * condvars blocking right away and with them spinning first.
+ */
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <ostd/io.hh>
+#include <ostd/channel.hh>
+
+using namespace ostd;
+
+constexpr int NUM_MSGS = 1000000;
+constexpr int NUM_RUNS = 3;
+constexpr int NUM_PINGS = 100000;
+
+template<typename C>
+static double bench(C ch, int nthreads) {
+    double best = 0.0;
+    for (int r = 0; r < NUM_RUNS; ++r) {
+        std::vector<std::thread> thrs;
+        auto tb = std::chrono::steady_clock::now();
+        for (int i = 0; i < nthreads; ++i) {
+            thrs.emplace_back([ch, nthreads]() mutable {
+                for (int j = 0; j < (NUM_MSGS / nthreads); ++j) {
+                    ch.put(j);
+                }
+            });
+            thrs.emplace_back([ch, nthreads]() mutable {
+                for (int j = 0; j < (NUM_MSGS / nthreads); ++j) {
+                    ch.get();
+                }
+            });
+        }
+        for (auto &t: thrs) {
+            t.join();
+        }
+        auto te = std::chrono::steady_clock::now();
+        double t = std::chrono::duration<double>(te - tb).count();
+        best = std::max(best, (NUM_MSGS / nthreads) * nthreads / t / 1e6);
+    }
+    return best;
+}
+
+template<typename C>
+static double bench_handoff(C ping, C pong) {
+    double best = 0.0;
+    for (int r = 0; r < NUM_RUNS; ++r) {
+        std::thread thr{[ping, pong]() mutable {
+            for (int j = 0; j < NUM_PINGS; ++j) {
+                pong.put(ping.get());
+            }
+        }};
+        auto tb = std::chrono::steady_clock::now();
+        for (int j = 0; j < NUM_PINGS; ++j) {
+            ping.put(j);
+            pong.get();
+        }
+        auto te = std::chrono::steady_clock::now();
+        thr.join();
+        double t = std::chrono::duration<double>(te - tb).count();
+        t = t / (2 * NUM_PINGS) * 1e9;
+        if (!r || (t < best)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+int main() {
+    writefln("%-10s %12s %12s", "threads", "channel", "bounded");
+    for (int n: { 1, 2, 4 }) {
+        double tu = bench(channel<int>{}, n);
+        double tb = bench(bounded_channel<int>{1024}, n);
+        writefln("%-10s %12.2f %12.2f", format(
+            appender<std::string>(), "%dx%d", n, n
+        ).get(), tu, tb);
+    }
+    writefln("");
+    writefln("%-10s %12s %12s", "handoff", "channel", "bounded");
+    bool spin = condvar_spin();
+    for (bool sp: { false, true }) {
+        set_condvar_spin(sp);
+        double tu = bench_handoff(channel<int>{}, channel<int>{});
+        double tb = bench_handoff(
+            bounded_channel<int>{1}, bounded_channel<int>{1}
+        );
+        writefln("%-10s %12.0f %12.0f", sp ? "spin" : "park", tu, tb);
+    }
+    set_condvar_spin(spin);
+}
@@ -0,0 +1,135 @@
+/* Compares ostd::sort against std::sort on a few input patterns,
+ * and the radix sorts against both on random integer ids.
+ *
+ * Every pattern is sorted several times and the best time is reported,
+ * in milliseconds; ints use the branchless partitioning, strings don't.
+ */
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include <ostd/io.hh>
+#include <ostd/algorithm.hh>
+
+using namespace ostd;
+
+constexpr std::size_t NUM_ELEMS = 1000000;
+constexpr int NUM_RUNS = 5;
+
+static std::vector<int> make_input(std::string const &kind, std::size_t n) {
+    std::vector<int> ret(n);
+    std::mt19937 rng{1234};
+    for (std::size_t i = 0; i < n; ++i) {
+        if (kind == "random") {
+            ret[i] = int(rng());
+        } else if (kind == "sorted") {
+            ret[i] = int(i);
+        } else if (kind == "reversed") {
+            ret[i] = int(n - i);
+        } else if (kind == "few_unique") {
+            ret[i] = int(rng() % 16);
+        } else if (kind == "organ_pipe") {
+            ret[i] = int((i < (n / 2)) ? i : (n - i));
+        } else if (kind == "sawtooth") {
+            ret[i] = int(i % 1000);
+        } else if (kind == "sorted_tail") {
+            ret[i] = (i < (n - n / 100)) ? int(i) : int(rng());
+        }
+    }
+    return ret;
+}
+
+template<typename T, typename F>
+static double bench(std::vector<T> const &input, F sorter) {
+    double best = 0.0;
+    for (int i = 0; i < NUM_RUNS; ++i) {
+        std::vector<T> v = input;
+        auto tb = std::chrono::steady_clock::now();
+        sorter(v);
+        auto te = std::chrono::steady_clock::now();
+        if (!std::is_sorted(v.begin(), v.end())) {
+            throw std::runtime_error{"sort failed"};
+        }
+        double t = std::chrono::duration<double, std::milli>(te - tb).count();
+        if (!i || (t < best)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+template<typename T>
+static void bench_pattern(std::string const &name, std::vector<T> const &in) {
+    double ts = bench(in, [](std::vector<T> &v) {
+        std::sort(v.begin(), v.end());
+    });
+    double to = bench(in, [](std::vector<T> &v) {
+        sort(iter(v));
+    });
+    writefln("%-20s %10.2f %10.2f %8.2fx", name, ts, to, ts / to);
+}
+
+template<typename T>
+static void bench_ids(std::string const &name) {
+    std::vector<T> in(NUM_ELEMS * 4);
+    std::mt19937_64 rng{4321};
+    for (auto &v: in) {
+        v = T(rng());
+    }
+    double ts = bench(in, [](std::vector<T> &v) {
+        std::sort(v.begin(), v.end());
+    });
+    double to = bench(in, [](std::vector<T> &v) {
+        sort(iter(v));
+    });
+    double tr = bench(in, [](std::vector<T> &v) {
+        radix_sort(iter(v));
+    });
+    double ti = bench(in, [](std::vector<T> &v) {
+        inplace_radix_sort(iter(v));
+    });
+    writefln("%-20s %10.2f %10.2f %10.2f %10.2f", name, ts, to, tr, ti);
+}
+
+int main() {
+    char const *kinds[] = {
+        "random", "sorted", "reversed", "few_unique",
+        "organ_pipe", "sawtooth", "sorted_tail"
+    };
+    writefln(
+        "%-20s %10s %10s %9s", "int pattern", "std::sort", "ostd::sort",
+        "ratio"
+    );
+    for (auto kind: kinds) {
+        bench_pattern(kind, make_input(kind, NUM_ELEMS));
+    }
+    writeln();
+    writefln(
+        "%-20s %10s %10s %9s", "string pattern", "std::sort", "ostd::sort",
+        "ratio"
+    );
+    for (auto kind: kinds) {
+        auto ints = make_input(kind, NUM_ELEMS / 4);
+        std::vector<std::string> strs;
+        strs.reserve(ints.size());
+        for (int i: ints) {
+            /* pad so that the strings are ordered like the numbers */
+            auto app = appender<std::string>();
+            format(app, "%010d", unsigned(i));
+            strs.push_back(std::move(app.get()));
+        }
+        bench_pattern(kind, strs);
+    }
+    writeln();
+    writefln(
+        "%-20s %10s %10s %10s %10s", "random ids",
+        "std::sort", "ostd::sort", "radix", "inplace"
+    );
+    bench_ids<std::uint32_t>("uint32");
+    bench_ids<std::uint64_t>("uint64");
+}
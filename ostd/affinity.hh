@@ -0,0 +1,124 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file affinity.hh
+ *
+ * @brief CPU topology and placement of worker threads.
+ *
+ * This file provides a way to query which CPUs the process may run on and
+ * how they share cores and caches, and to describe how the worker threads
+ * of ostd::thread_pool and the coroutine schedulers should be placed on
+ * them. Pinning workers gives repeatable latency and keeps hot tasks from
+ * migrating between sockets.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_AFFINITY_HH
+#define OSTD_AFFINITY_HH
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <ostd/platform.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief A logical CPU as reported by ostd::cpu_topology().
+ *
+ * Cores and cache domains are identified by the lowest numbered CPU
+ * in them, so that CPUs sharing one compare equal.
+ */
+struct cpu_info {
+    unsigned int id;      ///< The logical CPU number.
+    unsigned int core;    ///< The physical core.
+    unsigned int package; ///< The physical package (socket).
+    unsigned int cache;   ///< The last level cache domain.
+};
+
+/** @brief How worker threads are placed on CPUs.
+ *
+ * With every policy but the first, each thread is pinned to a single
+ * CPU; the policy decides the order in which the threads take them.
+ * When there are more threads than CPUs, the order wraps around.
+ *
+ * Both ostd::thread_placement::SPREAD and ostd::thread_placement::PACK
+ * go through all the physical cores of a cache domain before using the
+ * second hardware thread of any of them.
+ */
+enum class thread_placement {
+    NONE = 0, ///< Not pinned, but restricted to the given CPUs if any.
+    PIN,      ///< Pinned to the given CPUs in the given order.
+    SPREAD,   ///< Pinned round robin across the cache domains.
+    PACK      ///< Pinned filling one cache domain before the next.
+};
+
+/** @brief The placement and naming of a set of worker threads.
+ *
+ * Given to ostd::thread_pool::set_affinity() and
+ * ostd::basic_coroutine_scheduler::set_affinity().
+ */
+struct thread_affinity {
+    /** @brief The placement policy. */
+    thread_placement placement = thread_placement::NONE;
+    /** @brief The CPUs to use, all available ones when empty. */
+    std::vector<unsigned int> cpus{};
+    /** @brief If not empty, threads are named `name-N` with an index. */
+    std::string name{};
+};
+
+/** @brief Gets the CPUs the process may run on, in ascending order.
+ *
+ * The topology is read from `/sys/devices/system/cpu` on Linux. Where
+ * it's not available, every CPU is reported as its own core within a
+ * single package and cache domain.
+ *
+ * @throws std::system_error on failure.
+ */
+OSTD_EXPORT std::vector<cpu_info> cpu_topology();
+
+/** @brief Gets the order in which threads are placed on CPUs.
+ *
+ * The `i`-th thread of a pool or scheduler is placed on the CPU at index
+ * `i` modulo the size of the result. The result is empty if the threads
+ * are not to be pinned.
+ *
+ * @throws std::system_error with `EINVAL` if any of the requested CPUs
+ *         is not available to the process.
+ */
+OSTD_EXPORT std::vector<unsigned int> thread_cpus(thread_affinity const &aff);
+
+namespace detail {
+    /* the computed placement of a set of threads; every thread applies
+     * it to itself when it starts, so nothing is done from the outside
+     */
+    struct OSTD_EXPORT thread_placer {
+        thread_placer() {}
+        thread_placer(thread_affinity const &aff);
+
+        void apply(std::size_t idx) const noexcept;
+
+        bool empty() const noexcept {
+            return p_cpus.empty() && p_name.empty();
+        }
+
+    private:
+        std::vector<unsigned int> p_cpus{};
+        std::string p_name{};
+        bool p_pin = false;
+    };
+} /* namespace detail */
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
@@ -20,14 +20,25 @@
 
 #include <ostd/unit_test.hh>
 
-#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <utility>
 #include <functional>
 #include <type_traits>
 #include <algorithm>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #ifdef OSTD_BUILD_TESTS
-#include <vector>
+#include <ostd/thread_pool.hh>
 #endif
 
 #include <ostd/range.hh>
@@ -145,18 +156,111 @@ OSTD_UNIT_TEST {
 /* sorting */
 
 namespace detail {
+    /* the sorting engine is a pattern-defeating quicksort, after the
+     * algorithm by Orson Peters; it's an introsort that detects inputs
+     * that are already (or almost) sorted, deals with runs of equal keys
+     * in linear time, shuffles its pivots around when they turn out bad
+     * and only falls back to heapsort after many bad partitions; for
+     * arithmetic types compared with the standard comparators it also
+     * uses a branchless block partition (see "BlockQuicksort: How Branch
+     * Mispredictions don't affect Quicksort" by Edelkamp and Weiss)
+     *
+     * everything works with indexes into a single range, because the
+     * unguarded insertion sort needs to look before the current part
+     */
+    constexpr std::size_t PDQ_INSORT_THRESHOLD   = 24;
+    constexpr std::size_t PDQ_NINTHER_THRESHOLD  = 128;
+    constexpr std::size_t PDQ_PARTIAL_INSORT_MAX = 8;
+    constexpr std::size_t PDQ_BLOCK_SIZE         = 64;
+
+    template<typename R, typename C>
+    inline constexpr bool pdq_branchless =
+        std::is_arithmetic_v<range_value_t<R>> &&
+        std::is_same_v<range_reference_t<R>, range_value_t<R> &> && (
+            std::is_same_v<C, std::less<range_value_t<R>>> ||
+            std::is_same_v<C, std::greater<range_value_t<R>>> ||
+            std::is_same_v<C, std::less<>> ||
+            std::is_same_v<C, std::greater<>>
+        );
+
+    inline int pdq_log2(std::size_t n) {
+        int ret = 0;
+        while (n >>= 1) {
+            ++ret;
+        }
+        return ret;
+    }
+
+    template<typename R, typename C>
+    inline void insort(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
+        if (b == e) {
+            return;
+        }
+        for (range_size_t<R> i = b + 1; i < e; ++i) {
+            range_size_t<R> j = i;
+            if (compare(range[j], range[j - 1])) {
+                range_value_t<R> v{std::move(range[j])};
+                do {
+                    range[j] = std::move(range[j - 1]);
+                    --j;
+                } while ((j != b) && compare(v, range[j - 1]));
+                range[j] = std::move(v);
+            }
+        }
+    }
+
+    /* the element right before b is known to be not greater than
+     * anything in [b, e) so it can act as a sentinel
+     */
+    template<typename R, typename C>
+    inline void insort_unguarded(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
+        if (b == e) {
+            return;
+        }
+        for (range_size_t<R> i = b + 1; i < e; ++i) {
+            range_size_t<R> j = i;
+            if (compare(range[j], range[j - 1])) {
+                range_value_t<R> v{std::move(range[j])};
+                do {
+                    range[j] = std::move(range[j - 1]);
+                    --j;
+                } while (compare(v, range[j - 1]));
+                range[j] = std::move(v);
+            }
+        }
+    }
+
+    /* gives up once too many elements had to be moved, returns whether
+     * the part has been sorted in the end
+     */
     template<typename R, typename C>
-    inline void insort(R range, C &compare) {
-        range_size_t<R> rlen = range.size();
-        for (range_size_t<R> i = 1; i < rlen; ++i) {
+    inline bool insort_partial(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
+        if (b == e) {
+            return true;
+        }
+        range_size_t<R> moved = 0;
+        for (range_size_t<R> i = b + 1; i < e; ++i) {
             range_size_t<R> j = i;
-            range_value_t<R> v{std::move(range[i])};
-            while (j > 0 && !compare(range[j - 1], v)) {
-                range[j] = std::move(range[j - 1]);
-                --j;
+            if (compare(range[j], range[j - 1])) {
+                range_value_t<R> v{std::move(range[j])};
+                do {
+                    range[j] = std::move(range[j - 1]);
+                    --j;
+                } while ((j != b) && compare(v, range[j - 1]));
+                range[j] = std::move(v);
+                moved += i - j;
+            }
+            if (moved > PDQ_PARTIAL_INSORT_MAX) {
+                return false;
             }
-            range[j] = std::move(v);
         }
+        return true;
     }
 
     template<typename R, typename C>
@@ -186,6 +290,9 @@ namespace detail {
     template<typename R, typename C>
     inline void heapsort(R range, C &compare) {
         range_size_t<R> len = range.size();
+        if (len < 2) {
+            return;
+        }
         range_size_t<R> st = (len - 2) / 2;
         for (;;) {
             detail::hs_sift_down(range, st, len - 1, compare);
@@ -203,35 +310,292 @@ namespace detail {
     }
 
     template<typename R, typename C>
-    inline void introloop(R range, C &compare, range_size_t<R> depth) {
+    inline void pdq_sort2(
+        R &range, range_size_t<R> a, range_size_t<R> b, C &compare
+    ) {
+        if (compare(range[b], range[a])) {
+            using std::swap;
+            swap(range[a], range[b]);
+        }
+    }
+
+    template<typename R, typename C>
+    inline void pdq_sort3(
+        R &range, range_size_t<R> a, range_size_t<R> b, range_size_t<R> c,
+        C &compare
+    ) {
+        detail::pdq_sort2(range, a, b, compare);
+        detail::pdq_sort2(range, b, c, compare);
+        detail::pdq_sort2(range, a, b, compare);
+    }
+
+    /* partitions [b, e) around the pivot at b, elements equal to the
+     * pivot go to the right; the pivot must be the median of at least
+     * three elements, as the scanning loops rely on it as a sentinel;
+     * returns the final position of the pivot and whether nothing had
+     * to be swapped
+     */
+    template<typename R, typename C>
+    inline std::pair<range_size_t<R>, bool> pdq_partition_right(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
         using std::swap;
-        if (range.size() <= 10) {
-            detail::insort(range, compare);
-            return;
+        range_value_t<R> pivot{std::move(range[b])};
+        range_size_t<R> first = b, last = e;
+        while (compare(range[++first], pivot));
+        if ((first - 1) == b) {
+            while ((first < last) && !compare(range[--last], pivot));
+        } else {
+            while (!compare(range[--last], pivot));
         }
-        if (depth == 0) {
-            detail::heapsort(range, compare);
-            return;
+        bool done = (first >= last);
+        while (first < last) {
+            swap(range[first], range[last]);
+            while (compare(range[++first], pivot));
+            while (!compare(range[--last], pivot));
         }
-        swap(range[range.size() / 2], range.back());
-        range_size_t<R> pi = 0;
-        R pr = range;
-        pr.pop_back();
-        for (; !pr.empty(); pr.pop_front()) {
-            if (compare(pr.front(), range.back())) {
-                swap(pr.front(), range[pi++]);
+        range_size_t<R> pp = first - 1;
+        range[b] = std::move(range[pp]);
+        range[pp] = std::move(pivot);
+        return std::make_pair(pp, done);
+    }
+
+    template<typename R>
+    inline void pdq_swap_offsets(
+        R &range, range_size_t<R> lbase, range_size_t<R> rbase,
+        unsigned char const *offl, unsigned char const *offr,
+        std::size_t num, bool use_swaps
+    ) {
+        if (use_swaps) {
+            /* the swaps are needed to keep descending inputs linear */
+            using std::swap;
+            for (std::size_t i = 0; i < num; ++i) {
+                swap(range[lbase + offl[i]], range[rbase - offr[i]]);
             }
+        } else if (num > 0) {
+            /* otherwise rotate through a cycle, saving a third of moves */
+            range_size_t<R> l = lbase + offl[0], r = rbase - offr[0];
+            range_value_t<R> tmp{std::move(range[l])};
+            range[l] = std::move(range[r]);
+            for (std::size_t i = 1; i < num; ++i) {
+                l = lbase + offl[i];
+                range[r] = std::move(range[l]);
+                r = rbase - offr[i];
+                range[l] = std::move(range[r]);
+            }
+            range[r] = std::move(tmp);
         }
-        swap(range[pi], range.back());
-        detail::introloop(range.slice(0, pi), compare, depth - 1);
-        detail::introloop(range.slice(pi + 1), compare, depth - 1);
     }
 
+    /* like pdq_partition_right, but the comparison results are only
+     * recorded as offsets into a block and the elements are swapped
+     * later, so there are no branches to mispredict in the inner loops
+     */
     template<typename R, typename C>
-    inline void introsort(R range, C &compare) {
-        detail::introloop(range, compare, static_cast<range_size_t<R>>(
-            2 * (std::log(range.size()) / std::log(2))
-        ));
+    inline std::pair<range_size_t<R>, bool> pdq_partition_right_branchless(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
+        using std::swap;
+        range_value_t<R> pivot{std::move(range[b])};
+        range_size_t<R> first = b, last = e;
+        while (compare(range[++first], pivot));
+        if ((first - 1) == b) {
+            while ((first < last) && !compare(range[--last], pivot));
+        } else {
+            while (!compare(range[--last], pivot));
+        }
+        bool done = (first >= last);
+        if (!done) {
+            swap(range[first], range[last]);
+            ++first;
+            alignas(64) unsigned char offl[PDQ_BLOCK_SIZE];
+            alignas(64) unsigned char offr[PDQ_BLOCK_SIZE];
+            range_size_t<R> lbase = first, rbase = last;
+            std::size_t numl = 0, numr = 0, startl = 0, startr = 0;
+            while (first < last) {
+                /* fill the blocks with the elements on the wrong side */
+                std::size_t unknown = last - first;
+                std::size_t lsplit = (numl == 0)
+                    ? ((numr == 0) ? (unknown / 2) : unknown) : 0;
+                std::size_t rsplit = (numr == 0) ? (unknown - lsplit) : 0;
+                lsplit = std::min(lsplit, PDQ_BLOCK_SIZE);
+                rsplit = std::min(rsplit, PDQ_BLOCK_SIZE);
+                for (std::size_t i = 0; i < lsplit; ++i) {
+                    offl[numl] = static_cast<unsigned char>(i);
+                    numl += !compare(range[first], pivot);
+                    ++first;
+                }
+                for (std::size_t i = 0; i < rsplit;) {
+                    offr[numr] = static_cast<unsigned char>(++i);
+                    numr += compare(range[--last], pivot);
+                }
+                std::size_t num = std::min(numl, numr);
+                detail::pdq_swap_offsets(
+                    range, lbase, rbase, offl + startl, offr + startr,
+                    num, numl == numr
+                );
+                numl -= num;
+                numr -= num;
+                startl += num;
+                startr += num;
+                if (numl == 0) {
+                    startl = 0;
+                    lbase = first;
+                }
+                if (numr == 0) {
+                    startr = 0;
+                    rbase = last;
+                }
+            }
+            /* one of the blocks may have leftovers, move them in place */
+            if (numl) {
+                while (numl--) {
+                    swap(range[lbase + offl[startl + numl]], range[--last]);
+                }
+                first = last;
+            }
+            if (numr) {
+                while (numr--) {
+                    swap(range[rbase - offr[startr + numr]], range[first]);
+                    ++first;
+                }
+            }
+        }
+        range_size_t<R> pp = first - 1;
+        range[b] = std::move(range[pp]);
+        range[pp] = std::move(pivot);
+        return std::make_pair(pp, done);
+    }
+
+    /* the opposite of pdq_partition_right, elements equal to the pivot
+     * go to the left; used when the pivot is equal to the element right
+     * before b, in which case the left part is all equal and done
+     */
+    template<typename R, typename C>
+    inline range_size_t<R> pdq_partition_left(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare
+    ) {
+        using std::swap;
+        range_value_t<R> pivot{std::move(range[b])};
+        range_size_t<R> first = b, last = e;
+        while (compare(pivot, range[--last]));
+        if ((last + 1) == e) {
+            while ((first < last) && !compare(pivot, range[++first]));
+        } else {
+            while (!compare(pivot, range[++first]));
+        }
+        while (first < last) {
+            swap(range[first], range[last]);
+            while (compare(pivot, range[--last]));
+            while (!compare(pivot, range[++first]));
+        }
+        range[b] = std::move(range[last]);
+        range[last] = std::move(pivot);
+        return last;
+    }
+
+    template<bool Branchless, typename R, typename C>
+    inline void pdq_loop(
+        R range, range_size_t<R> b, range_size_t<R> e, C &compare,
+        int bad_allowed, bool leftmost
+    ) {
+        using S = range_size_t<R>;
+        using std::swap;
+        for (;;) {
+            S size = e - b;
+            if (size < PDQ_INSORT_THRESHOLD) {
+                if (leftmost) {
+                    detail::insort(range, b, e, compare);
+                } else {
+                    detail::insort_unguarded(range, b, e, compare);
+                }
+                return;
+            }
+            /* median of three, or pseudomedian of nine for bigger parts */
+            S s2 = size / 2;
+            if (size > PDQ_NINTHER_THRESHOLD) {
+                detail::pdq_sort3(range, b, b + s2, e - 1, compare);
+                detail::pdq_sort3(range, b + 1, b + s2 - 1, e - 2, compare);
+                detail::pdq_sort3(range, b + 2, b + s2 + 1, e - 3, compare);
+                detail::pdq_sort3(
+                    range, b + s2 - 1, b + s2, b + s2 + 1, compare
+                );
+                swap(range[b], range[b + s2]);
+            } else {
+                detail::pdq_sort3(range, b + s2, b, e - 1, compare);
+            }
+            /* nothing here is smaller than the element before b; if the
+             * pivot is equal to it, take all of the equal elements out
+             */
+            if (!leftmost && !compare(range[b - 1], range[b])) {
+                b = detail::pdq_partition_left(range, b, e, compare) + 1;
+                continue;
+            }
+            std::pair<S, bool> pr;
+            if constexpr(Branchless) {
+                pr = detail::pdq_partition_right_branchless(
+                    range, b, e, compare
+                );
+            } else {
+                pr = detail::pdq_partition_right(range, b, e, compare);
+            }
+            S pp = pr.first;
+            S lsize = pp - b, rsize = e - (pp + 1);
+            if ((lsize < (size / 8)) || (rsize < (size / 8))) {
+                /* bad partition, give up after too many of those */
+                if (--bad_allowed == 0) {
+                    detail::heapsort(range.slice(b, e), compare);
+                    return;
+                }
+                /* break up patterns that may have caused it */
+                if (lsize >= PDQ_INSORT_THRESHOLD) {
+                    swap(range[b], range[b + lsize / 4]);
+                    swap(range[pp - 1], range[pp - lsize / 4]);
+                    if (lsize > PDQ_NINTHER_THRESHOLD) {
+                        swap(range[b + 1], range[b + (lsize / 4 + 1)]);
+                        swap(range[b + 2], range[b + (lsize / 4 + 2)]);
+                        swap(range[pp - 2], range[pp - (lsize / 4 + 1)]);
+                        swap(range[pp - 3], range[pp - (lsize / 4 + 2)]);
+                    }
+                }
+                if (rsize >= PDQ_INSORT_THRESHOLD) {
+                    swap(range[pp + 1], range[pp + (1 + rsize / 4)]);
+                    swap(range[e - 1], range[e - rsize / 4]);
+                    if (rsize > PDQ_NINTHER_THRESHOLD) {
+                        swap(range[pp + 2], range[pp + (2 + rsize / 4)]);
+                        swap(range[pp + 3], range[pp + (3 + rsize / 4)]);
+                        swap(range[e - 2], range[e - (1 + rsize / 4)]);
+                        swap(range[e - 3], range[e - (2 + rsize / 4)]);
+                    }
+                }
+            } else if (
+                /* a good partition that needed no swaps suggests the input
+                 * may be already sorted, so try that at a bounded cost
+                 */
+                pr.second &&
+                detail::insort_partial(range, b, pp, compare) &&
+                detail::insort_partial(range, pp + 1, e, compare)
+            ) {
+                return;
+            }
+            /* recurse into the left part, loop on the right one */
+            detail::pdq_loop<Branchless>(
+                range, b, pp, compare, bad_allowed, leftmost
+            );
+            b = pp + 1;
+            leftmost = false;
+        }
+    }
+
+    template<typename R, typename C>
+    inline void pdqsort(R range, C &compare) {
+        range_size_t<R> len = range.size();
+        if (len < 2) {
+            return;
+        }
+        detail::pdq_loop<detail::pdq_branchless<R, C>>(
+            range, 0, len, compare, detail::pdq_log2(len), true
+        );
     }
 } /* namespace detail */
 
@@ -244,12 +608,16 @@ namespace detail {
  * The items are swapped in the range, which means the range must also
  * meet the conditions of ostd::is_range_element_swappable.
  *
- * The worst-case and average performance of this algorithm os `O(n log n)`.
- * The best-case performance is `O(n)`. This happens when the range is small
- * enough and already sorted (insertion sort is used for small ranges).
+ * The worst-case and average performance of this algorithm is `O(n log n)`.
+ * The best-case performance is `O(n)`. This happens when the range is
+ * already sorted or sorted in reverse, or when it only contains a few
+ * distinct keys.
  *
- * The actual algorithm used is a hybrid algorithm between quicksort and
- * heapsort (intosort) with insertion sort for small ranges.
+ * The actual algorithm used is a pattern-defeating quicksort, which is an
+ * introsort (a hybrid of quicksort and heapsort with insertion sort for
+ * small ranges) that recognizes common patterns in the input. Arithmetic
+ * types compared with `std::less` or `std::greater` use a partitioning
+ * scheme without unpredictable branches.
  *
  * @see ostd::sort()
  */
@@ -259,7 +627,7 @@ inline FiniteRandomRange sort_cmp(FiniteRandomRange range, Compare compare) {
         is_range_element_swappable<FiniteRandomRange>,
         "The range element accessors must allow swapping"
     );
-    detail::introsort(range, compare);
+    detail::pdqsort(range, compare);
     return range;
 }
 
@@ -289,6 +657,508 @@ inline auto sort() {
     return [](auto &obj) { return sort(obj); };
 }
 
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    /* the usual suspects: random, sorted, reversed, few distinct keys,
+     * organ pipe and sawtooth, with sizes around the internal thresholds
+     */
+    auto fill = [](std::vector<int> &v, int kind) {
+        unsigned x = 7;
+        int n = int(v.size());
+        for (int i = 0; i < n; ++i) {
+            x = x * 1103515245 + 12345;
+            switch (kind) {
+                case 0: v[i] = int(x >> 8); break;
+                case 1: v[i] = i; break;
+                case 2: v[i] = n - i; break;
+                case 3: v[i] = int((x >> 8) % 4); break;
+                case 4: v[i] = (i < n / 2) ? i : (n - i); break;
+                default: v[i] = i % 37; break;
+            }
+        }
+    };
+    for (int n: { 0, 1, 2, 23, 24, 25, 129, 1000, 30000 }) {
+        for (int kind = 0; kind < 6; ++kind) {
+            std::vector<int> v(n);
+            fill(v, kind);
+            std::vector<int> w = v;
+            std::sort(w.begin(), w.end());
+            sort(iter(v));
+            fail_if_not(v == w);
+            fill(v, kind);
+            iter(v) | sort_cmp(std::greater<int>{});
+            fail_if_not(std::equal(v.begin(), v.end(), w.rbegin()));
+            /* not branchless */
+            fill(v, kind);
+            sort_cmp(iter(v), [](int a, int b) { return a < b; });
+            fail_if_not(v == w);
+        }
+    }
+}
+#endif
+
+/* radix sorting */
+
+namespace detail {
+    constexpr std::size_t RADIX_BITS = 8;
+    constexpr std::size_t RADIX_BUCKETS = std::size_t(1) << RADIX_BITS;
+    /* MSD buckets smaller than this are finished by comparison sort */
+    constexpr std::size_t RADIX_MSD_THRESHOLD = 64;
+    /* LSD sorts larger than this many bytes are split by MSD first */
+    constexpr std::size_t RADIX_LSD_CACHE = std::size_t(1) << 18;
+
+    /* maps a key to an unsigned integer of the same size that sorts in
+     * the same order; signed integers get their sign bit flipped, IEEE
+     * floats get all bits flipped when negative and the sign bit flipped
+     * otherwise
+     */
+    template<typename K>
+    inline auto radix_key(K key) {
+        static_assert(
+            std::is_integral_v<K> || std::is_floating_point_v<K>,
+            "radix sort keys must be integers or floating point"
+        );
+        if constexpr(std::is_floating_point_v<K>) {
+            static_assert(
+                std::numeric_limits<K>::is_iec559 && (
+                    (sizeof(K) == sizeof(std::uint32_t)) ||
+                    (sizeof(K) == sizeof(std::uint64_t))
+                ),
+                "only IEEE single and double precision keys are supported"
+            );
+            using U = std::conditional_t<
+                sizeof(K) == sizeof(std::uint32_t), std::uint32_t, std::uint64_t
+            >;
+            U ret;
+            std::memcpy(&ret, &key, sizeof(K));
+            constexpr U sbit = U(1) << (sizeof(U) * 8 - 1);
+            return (ret & sbit) ? U(~ret) : U(ret | sbit);
+        } else if constexpr(std::is_same_v<K, bool>) {
+            return static_cast<unsigned char>(key);
+        } else {
+            using U = std::make_unsigned_t<K>;
+            U ret = static_cast<U>(key);
+            if constexpr(std::is_signed_v<K>) {
+                ret ^= U(1) << (sizeof(U) * 8 - 1);
+            }
+            return ret;
+        }
+    }
+
+    template<typename T, typename F>
+    using radix_key_t = decltype(detail::radix_key(
+        std::declval<F &>()(std::declval<T const &>())
+    ));
+
+    template<typename T, typename F>
+    inline std::size_t radix_digit(T const &v, F &keyf, std::size_t shift) {
+        return std::size_t(
+            detail::radix_key(keyf(v)) >> shift
+        ) & (RADIX_BUCKETS - 1);
+    }
+
+    /* uninitialized scratch space for the LSD passes, the elements
+     * are move constructed into it during the first pass
+     */
+    template<typename T>
+    struct radix_buffer {
+        radix_buffer(std::size_t n):
+            p_buf{std::allocator<T>{}.allocate(n)}, p_size{n}
+        {}
+
+        ~radix_buffer() {
+            if (p_init) {
+                for (std::size_t i = 0; i < p_size; ++i) {
+                    p_buf[i].~T();
+                }
+            }
+            std::allocator<T>{}.deallocate(p_buf, p_size);
+        }
+
+        radix_buffer(radix_buffer const &) = delete;
+        radix_buffer &operator=(radix_buffer const &) = delete;
+
+        T *p_buf;
+        std::size_t p_size;
+        bool p_init = false;
+    };
+
+    template<bool Construct, typename S, typename D, typename F>
+    inline void radix_scatter(
+        S &src, D &dst, std::size_t n, std::size_t *offs, F &keyf,
+        std::size_t shift
+    ) {
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t d = detail::radix_digit(src[i], keyf, shift);
+            if constexpr(Construct) {
+                using T = std::remove_reference_t<decltype(src[i])>;
+                new (&dst[offs[d]++]) T(std::move(src[i]));
+            } else {
+                dst[offs[d]++] = std::move(src[i]);
+            }
+        }
+    }
+
+    /* the LSD passes over the low `npass` digits; the elements start out
+     * in the buffer when `inbuf` is set and always end up in the range
+     */
+    template<typename R, typename T, typename F>
+    inline void radix_lsd_passes(
+        R range, T *buf, F &keyf, std::size_t npass, bool inbuf, bool &init
+    ) {
+        using K = radix_key_t<T, F>;
+        std::size_t n = range.size();
+        /* all the digit histograms are built in a single pass */
+        std::vector<std::size_t> counts(npass * RADIX_BUCKETS);
+        for (std::size_t i = 0; i < n; ++i) {
+            K k = detail::radix_key(keyf(inbuf ? buf[i] : range[i]));
+            for (std::size_t p = 0; p < npass; ++p) {
+                ++counts[p * RADIX_BUCKETS + (
+                    std::size_t(k >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)
+                )];
+            }
+        }
+        for (std::size_t p = 0; p < npass; ++p) {
+            std::size_t *cnt = &counts[p * RADIX_BUCKETS];
+            std::size_t shift = p * RADIX_BITS;
+            /* every key has the same digit here, nothing to do */
+            if (cnt[detail::radix_digit(
+                inbuf ? buf[0] : range[0], keyf, shift
+            )] == n) {
+                continue;
+            }
+            std::size_t off = 0;
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                std::size_t c = cnt[d];
+                cnt[d] = off;
+                off += c;
+            }
+            if (inbuf) {
+                detail::radix_scatter<false>(buf, range, n, cnt, keyf, shift);
+            } else if (init) {
+                detail::radix_scatter<false>(range, buf, n, cnt, keyf, shift);
+            } else {
+                detail::radix_scatter<true>(range, buf, n, cnt, keyf, shift);
+                init = true;
+            }
+            inbuf = !inbuf;
+        }
+        if (inbuf) {
+            for (std::size_t i = 0; i < n; ++i) {
+                range[i] = std::move(buf[i]);
+            }
+        }
+    }
+
+    /* plain LSD on large inputs scatters every pass all over memory, so
+     * those are first split by their most significant digit, leaving the
+     * LSD passes with buckets that stay in cache
+     */
+    template<typename R, typename T, typename F>
+    inline void radix_lsd(
+        R range, T *buf, F &keyf, std::size_t npass, bool inbuf, bool &init
+    ) {
+        constexpr std::size_t block = std::max(
+            RADIX_LSD_CACHE / sizeof(T), std::size_t(1)
+        );
+        std::size_t n = range.size();
+        for (; (npass > 1) && (n > block); --npass) {
+            std::size_t shift = (npass - 1) * RADIX_BITS;
+            std::size_t offs[RADIX_BUCKETS] = {}, ends[RADIX_BUCKETS];
+            for (std::size_t i = 0; i < n; ++i) {
+                ++offs[detail::radix_digit(
+                    inbuf ? buf[i] : range[i], keyf, shift
+                )];
+            }
+            if (offs[detail::radix_digit(
+                inbuf ? buf[0] : range[0], keyf, shift
+            )] == n) {
+                continue;
+            }
+            std::size_t off = 0;
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                std::size_t c = offs[d];
+                offs[d] = off;
+                off += c;
+                ends[d] = off;
+            }
+            if (inbuf) {
+                detail::radix_scatter<false>(buf, range, n, offs, keyf, shift);
+            } else if (init) {
+                detail::radix_scatter<false>(range, buf, n, offs, keyf, shift);
+            } else {
+                detail::radix_scatter<true>(range, buf, n, offs, keyf, shift);
+                init = true;
+            }
+            std::size_t b = 0;
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                if (ends[d] > b) {
+                    detail::radix_lsd(
+                        range.slice(b, ends[d]), buf + b, keyf, npass - 1,
+                        !inbuf, init
+                    );
+                }
+                b = ends[d];
+            }
+            return;
+        }
+        detail::radix_lsd_passes(range, buf, keyf, npass, inbuf, init);
+    }
+
+    template<typename R, typename F>
+    inline void radix_msd(R range, F &keyf, std::size_t shift) {
+        using T = range_value_t<R>;
+        for (;;) {
+            std::size_t n = range.size();
+            if (n < RADIX_MSD_THRESHOLD) {
+                auto cmp = [&keyf](T const &a, T const &b) {
+                    return detail::radix_key(keyf(a)) <
+                           detail::radix_key(keyf(b));
+                };
+                detail::pdqsort(range, cmp);
+                return;
+            }
+            std::size_t heads[RADIX_BUCKETS] = {}, tails[RADIX_BUCKETS];
+            for (std::size_t i = 0; i < n; ++i) {
+                ++heads[detail::radix_digit(range[i], keyf, shift)];
+            }
+            /* a single bucket for this digit, go straight to the next */
+            if (heads[detail::radix_digit(range[0], keyf, shift)] == n) {
+                if (!shift) {
+                    return;
+                }
+                shift -= RADIX_BITS;
+                continue;
+            }
+            std::size_t off = 0;
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                std::size_t c = heads[d];
+                heads[d] = off;
+                off += c;
+                tails[d] = off;
+            }
+            /* american flag permutation: swap every element into its
+             * bucket, following cycles until the current slot fits
+             */
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                while (heads[d] < tails[d]) {
+                    std::size_t dd = detail::radix_digit(
+                        range[heads[d]], keyf, shift
+                    );
+                    if (dd == d) {
+                        ++heads[d];
+                    } else {
+                        using std::swap;
+                        swap(range[heads[d]], range[heads[dd]++]);
+                    }
+                }
+            }
+            if (!shift) {
+                return;
+            }
+            std::size_t b = 0;
+            for (std::size_t d = 0; d < RADIX_BUCKETS; ++d) {
+                if ((tails[d] - b) > 1) {
+                    detail::radix_msd(
+                        range.slice(b, tails[d]), keyf, shift - RADIX_BITS
+                    );
+                }
+                b = tails[d];
+            }
+            return;
+        }
+    }
+
+    struct radix_identity {
+        template<typename T>
+        T const &operator()(T const &v) const {
+            return v;
+        }
+    };
+} /* namespace detail */
+
+/** @brief Sorts a range by integer or floating point keys.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag and
+ * meet the conditions of ostd::is_range_element_swappable; contiguous
+ * ranges and ranges over `std::vector` and the like are the intended
+ * use, as the algorithm is memory bound. The key function takes an
+ * `ostd::range_value_t<R> const &` and returns the key, which is either
+ * an integer type or an IEEE `float` or `double`. Integers are ordered by
+ * value and floating point keys are ordered by value too, except that
+ * negative zero comes before positive zero and NaNs go to either end
+ * depending on their sign bit.
+ *
+ * This is a radix sort with 8-bit digits; it allocates scratch space for
+ * all elements, which must be move constructible and assignable. Inputs
+ * too large for the cache are first split into buckets by their most
+ * significant digits, then every bucket is finished by LSD passes over
+ * the remaining digits, skipping digits all keys have in common, so its
+ * time is `O(n * sizeof(key))` independently of the input order. The key
+ * function is called several times for every element, so it should be
+ * cheap. The sort is stable. How much it gains over ostd::sort() depends
+ * on the key width and the memory bandwidth, so wide keys are worth
+ * measuring.
+ *
+ * @see ostd::radix_sort(), ostd::inplace_radix_sort_by()
+ */
+template<typename FiniteRandomRange, typename KeyFunction>
+inline FiniteRandomRange radix_sort_by(
+    FiniteRandomRange range, KeyFunction key
+) {
+    static_assert(
+        is_range_element_swappable<FiniteRandomRange>,
+        "The range element accessors must allow swapping"
+    );
+    using T = range_value_t<FiniteRandomRange>;
+    using K = detail::radix_key_t<T, KeyFunction>;
+    if (range.size() > 1) {
+        detail::radix_buffer<T> buf{range.size()};
+        detail::radix_lsd(
+            range, buf.p_buf, key, sizeof(K), false, buf.p_init
+        );
+    }
+    return range;
+}
+
+/** @brief A pipeable version of ostd::radix_sort_by().
+ *
+ * The key function is forwarded.
+ */
+template<typename KeyFunction>
+inline auto radix_sort_by(KeyFunction &&key) {
+    return [key = std::forward<KeyFunction>(key)](auto &obj) mutable {
+        return radix_sort_by(obj, std::forward<KeyFunction>(key));
+    };
+}
+
+/** @brief Like ostd::radix_sort_by() using the values as keys. */
+template<typename FiniteRandomRange>
+inline FiniteRandomRange radix_sort(FiniteRandomRange range) {
+    return radix_sort_by(range, detail::radix_identity{});
+}
+
+/** @brief A pipeable version of ostd::radix_sort(). */
+inline auto radix_sort() {
+    return [](auto &obj) { return radix_sort(obj); };
+}
+
+/** @brief Sorts a range by keys without extra memory.
+ *
+ * The keys are the same as with ostd::radix_sort_by(). This is an MSD
+ * radix sort (American flag sort), which permutes the elements into their
+ * buckets in place and then recurses into each bucket with the following
+ * digit, finishing small buckets with a comparison sort. It's typically
+ * a bit slower than ostd::radix_sort_by() but it doesn't allocate and only
+ * needs the elements to be swappable. The sort is not stable.
+ *
+ * @see ostd::inplace_radix_sort(), ostd::radix_sort_by()
+ */
+template<typename FiniteRandomRange, typename KeyFunction>
+inline FiniteRandomRange inplace_radix_sort_by(
+    FiniteRandomRange range, KeyFunction key
+) {
+    static_assert(
+        is_range_element_swappable<FiniteRandomRange>,
+        "The range element accessors must allow swapping"
+    );
+    using K = detail::radix_key_t<
+        range_value_t<FiniteRandomRange>, KeyFunction
+    >;
+    if (range.size() > 1) {
+        detail::radix_msd(range, key, (sizeof(K) - 1) * detail::RADIX_BITS);
+    }
+    return range;
+}
+
+/** @brief A pipeable version of ostd::inplace_radix_sort_by().
+ *
+ * The key function is forwarded.
+ */
+template<typename KeyFunction>
+inline auto inplace_radix_sort_by(KeyFunction &&key) {
+    return [key = std::forward<KeyFunction>(key)](auto &obj) mutable {
+        return inplace_radix_sort_by(obj, std::forward<KeyFunction>(key));
+    };
+}
+
+/** @brief Like ostd::inplace_radix_sort_by() using the values as keys. */
+template<typename FiniteRandomRange>
+inline FiniteRandomRange inplace_radix_sort(FiniteRandomRange range) {
+    return inplace_radix_sort_by(range, detail::radix_identity{});
+}
+
+/** @brief A pipeable version of ostd::inplace_radix_sort(). */
+inline auto inplace_radix_sort() {
+    return [](auto &obj) { return inplace_radix_sort(obj); };
+}
+
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    unsigned x = 99;
+    auto rnd = [&x]() {
+        x = x * 1103515245 + 12345;
+        return x;
+    };
+    /* the largest size goes through the MSD split for every key width */
+    for (std::size_t n: { 0, 1, 2, 63, 64, 1000, 20000, 150000 }) {
+        std::vector<std::uint32_t> u(n);
+        std::vector<std::int64_t> s(n);
+        std::vector<double> d(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            u[i] = rnd();
+            s[i] = std::int64_t(rnd()) * ((i % 3) ? -7919 : 7919);
+            d[i] = double(std::int32_t(rnd())) / 1024.0;
+        }
+        auto u2 = u, u3 = u;
+        auto s2 = s, s3 = s;
+        auto d2 = d, d3 = d;
+        std::sort(u.begin(), u.end());
+        std::sort(s.begin(), s.end());
+        std::sort(d.begin(), d.end());
+        radix_sort(iter(u2));
+        iter(u3) | inplace_radix_sort();
+        iter(s2) | radix_sort();
+        inplace_radix_sort(iter(s3));
+        radix_sort(iter(d2));
+        inplace_radix_sort(iter(d3));
+        fail_if_not(u == u2 && u == u3);
+        fail_if_not(s == s2 && s == s3);
+        fail_if_not(d == d2 && d == d3);
+    }
+    /* stability, and keys that differ only in some bytes; the sizes are
+     * below and above the MSD split for all key widths
+     */
+    auto stable = [&rnd](auto k, std::size_t n) {
+        using K = decltype(k);
+        constexpr std::size_t hi = sizeof(K) * 8 - 8;
+        std::vector<std::pair<K, int>> p(n);
+        for (std::size_t i = 0; i < p.size(); ++i) {
+            K v = K((rnd() >> 8) % 4);
+            v = K(v << hi) | K(K((rnd() >> 8) % 4) * 256);
+            p[i] = std::make_pair(v, int(i));
+        }
+        auto p2 = p;
+        auto pkey = [](auto const &v) { return v.first; };
+        radix_sort_by(iter(p), pkey);
+        fail_if_not(std::is_sorted(p.begin(), p.end()));
+        iter(p2) | inplace_radix_sort_by(pkey);
+        fail_if_not(std::is_sorted(
+            p2.begin(), p2.end(), [](auto const &a, auto const &b) {
+                return a.first < b.first;
+            }
+        ));
+    };
+    for (std::size_t n: { 5000, 150000 }) {
+        stable(std::uint16_t{}, n);
+        stable(std::uint32_t{}, n);
+        stable(std::uint64_t{}, n);
+    }
+}
+#endif
+
 /* min/max(_element) */
 
 /** @brief Finds the smallest element in the range.
@@ -1431,6 +2301,731 @@ inline auto filter(Predicate &&pred) {
     };
 }
 
+/* parallel algorithms */
+
+namespace detail {
+    template<typename E, typename = void>
+    constexpr bool par_can_post = false;
+
+    template<typename E>
+    constexpr bool par_can_post<E, std::void_t<decltype(
+        std::declval<E &>().post(std::declval<void (*)()>())
+    )>> = true;
+
+    /* counts outstanding chunks posted onto a thread pool */
+    struct par_latch {
+        void add() {
+            std::lock_guard<std::mutex> l{p_lock};
+            ++p_left;
+        }
+
+        void done(std::exception_ptr ep) {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (ep && !p_eptr) {
+                p_eptr = std::move(ep);
+            }
+            if (!--p_left) {
+                p_cond.notify_one();
+            }
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> l{p_lock};
+            while (p_left) {
+                p_cond.wait(l);
+            }
+            if (p_eptr) {
+                std::rethrow_exception(std::exchange(p_eptr, nullptr));
+            }
+        }
+
+    private:
+        std::mutex p_lock;
+        std::condition_variable p_cond;
+        std::exception_ptr p_eptr;
+        std::size_t p_left = 0;
+    };
+
+    template<typename S>
+    inline S par_grain(S n, S grain) {
+        if (grain) {
+            return grain;
+        }
+        /* a few chunks per thread so that uneven chunks even out */
+        S nthr = S(std::max(std::thread::hardware_concurrency(), 1U));
+        return std::max(n / (nthr * 4), S(1));
+    }
+
+    /* calls func(chunk_index, begin, end) on every grain-sized chunk
+     * of [0, n); the first chunk is run on the calling thread, the rest
+     * is handed over to the executor, and this waits until all are done
+     *
+     * any executor with post() (ostd::thread_pool) has the chunks posted,
+     * otherwise they are spawned (ostd::scheduler) and waited on via tids
+     */
+    template<typename E, typename S, typename F>
+    inline void par_run(E &exec, S n, S grain, F &func) {
+        S nchunks = (n + grain - 1) / grain;
+        if (nchunks <= 1) {
+            if (n) {
+                func(S(0), S(0), n);
+            }
+            return;
+        }
+        std::exception_ptr eptr;
+        if constexpr(par_can_post<E>) {
+            par_latch lt;
+            try {
+                for (S i = 1; i < nchunks; ++i) {
+                    lt.add();
+                    try {
+                        exec.post([&lt, &func, i, grain, n]() {
+                            try {
+                                func(
+                                    i, i * grain,
+                                    std::min(n, (i + 1) * grain)
+                                );
+                            } catch (...) {
+                                lt.done(std::current_exception());
+                                return;
+                            }
+                            lt.done(nullptr);
+                        });
+                    } catch (...) {
+                        lt.done(nullptr);
+                        throw;
+                    }
+                }
+                func(S(0), S(0), grain);
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+            try {
+                lt.wait();
+            } catch (...) {
+                if (!eptr) {
+                    eptr = std::current_exception();
+                }
+            }
+        } else {
+            using T = decltype(exec.spawn(std::declval<void (*)()>()));
+            std::vector<T> tids;
+            tids.reserve(nchunks - 1);
+            try {
+                for (S i = 1; i < nchunks; ++i) {
+                    tids.push_back(exec.spawn([&func, i, grain, n]() {
+                        func(i, i * grain, std::min(n, (i + 1) * grain));
+                    }));
+                }
+                func(S(0), S(0), grain);
+            } catch (...) {
+                eptr = std::current_exception();
+            }
+            for (auto &t: tids) {
+                try {
+                    t.get();
+                } catch (...) {
+                    if (!eptr) {
+                        eptr = std::current_exception();
+                    }
+                }
+            }
+        }
+        if (eptr) {
+            std::rethrow_exception(eptr);
+        }
+    }
+} /* namespace detail */
+
+/** @brief Executes `func` on each element of `range` in parallel.
+ *
+ * The range is split into chunks of `grain` elements using `slice()` and
+ * the chunks are processed by ostd::for_each() on the given executor. The
+ * executor is either an ostd::thread_pool (the chunks are queued with its
+ * `post()` method) or a scheduler (the chunks are spawned as tasks). The
+ * first chunk is always processed by the calling thread. This returns
+ * once every chunk has been processed.
+ *
+ * When the `grain` is zero, it's picked so that every hardware thread
+ * gets a few chunks. The function is shared by all chunks, so it has to
+ * be safe to call concurrently. The order of the calls is unspecified.
+ *
+ * If any chunk throws, the first exception is rethrown once all chunks
+ * are done. Do not call this from a task running on the same thread pool,
+ * as waiting for the chunks would occupy one of its workers.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag.
+ *
+ * @see ostd::for_each()
+ */
+template<typename Executor, typename FiniteRandomRange, typename UnaryFunction>
+inline void parallel_for_each(
+    Executor &exec, FiniteRandomRange range, UnaryFunction func,
+    range_size_t<FiniteRandomRange> grain = 0
+) {
+    using S = range_size_t<FiniteRandomRange>;
+    S n = range.size();
+    auto f = [&range, &func](S, S b, S e) {
+        for_each(range.slice(b, e), std::ref(func));
+    };
+    detail::par_run(exec, n, detail::par_grain(n, grain), f);
+}
+
+/** @brief A pipeable version of ostd::parallel_for_each().
+ *
+ * The executor is taken by reference, the function is forwarded.
+ */
+template<typename Executor, typename UnaryFunction>
+inline auto parallel_for_each(Executor &exec, UnaryFunction &&func) {
+    return [
+        &exec, func = std::forward<UnaryFunction>(func)
+    ](auto &obj) mutable {
+        return parallel_for_each(exec, obj, std::forward<UnaryFunction>(func));
+    };
+}
+
+/** @brief Reduces the `range` into `init` in parallel.
+ *
+ * This is the parallel counterpart of ostd::foldl(). Every chunk (see
+ * ostd::parallel_for_each() for how the range is split and processed)
+ * is folded separately using the `+` operator, starting with its first
+ * element, and the partial results are then added to `init` in order.
+ *
+ * Therefore, the `+` operator has to be associative, but it does not
+ * have to be commutative.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag.
+ *
+ * @see ostd::parallel_reduce_f(), ostd::foldl()
+ */
+template<typename Executor, typename FiniteRandomRange, typename Value>
+inline Value parallel_reduce(
+    Executor &exec, FiniteRandomRange range, Value init,
+    range_size_t<FiniteRandomRange> grain = 0
+) {
+    return parallel_reduce_f(exec, range, std::move(init), [](
+        auto const &a, auto const &b
+    ) {
+        return a + b;
+    }, grain);
+}
+
+/** @brief Reduces the `range` into `init` in parallel using `func`.
+ *
+ * Like ostd::parallel_reduce(), but the values are combined like
+ * `func(a, b)` instead of `a + b`. The `func` has to be associative
+ * and it has to accept `Value` as both arguments (when combining the
+ * partial results) as well as `Value` and the range's reference type.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag.
+ *
+ * @see ostd::parallel_reduce(), ostd::foldl_f()
+ */
+template<
+    typename Executor, typename FiniteRandomRange,
+    typename Value, typename BinaryFunction
+>
+inline Value parallel_reduce_f(
+    Executor &exec, FiniteRandomRange range, Value init, BinaryFunction func,
+    range_size_t<FiniteRandomRange> grain = 0
+) {
+    using S = range_size_t<FiniteRandomRange>;
+    S n = range.size();
+    grain = detail::par_grain(n, grain);
+    std::vector<std::optional<Value>> parts((n + grain - 1) / grain);
+    auto f = [&range, &func, &parts](S ci, S b, S e) {
+        auto r = range.slice(b, e);
+        Value v = r.front();
+        r.pop_front();
+        parts[ci].emplace(foldl_f(r, std::move(v), std::ref(func)));
+    };
+    detail::par_run(exec, n, grain, f);
+    for (auto &v: parts) {
+        init = func(std::move(init), std::move(*v));
+    }
+    return init;
+}
+
+/** @brief A pipeable version of ostd::parallel_reduce().
+ *
+ * The executor is taken by reference, the `init` is forwarded.
+ */
+template<typename Executor, typename Value>
+inline auto parallel_reduce(Executor &exec, Value &&init) {
+    return [&exec, init = std::forward<Value>(init)](auto &obj) mutable {
+        return parallel_reduce(exec, obj, std::forward<Value>(init));
+    };
+}
+
+/** @brief A pipeable version of ostd::parallel_reduce_f().
+ *
+ * The executor is taken by reference, the `init` and `func` are forwarded.
+ */
+template<typename Executor, typename Value, typename BinaryFunction>
+inline auto parallel_reduce_f(
+    Executor &exec, Value &&init, BinaryFunction &&func
+) {
+    return [
+        &exec, init = std::forward<Value>(init),
+        func = std::forward<BinaryFunction>(func)
+    ](auto &obj) mutable {
+        return parallel_reduce_f(
+            exec, obj, std::forward<Value>(init),
+            std::forward<BinaryFunction>(func)
+        );
+    };
+}
+
+/** @brief Transforms `irange` into `orange` in parallel.
+ *
+ * Every element of `irange` is mapped through `func` and assigned to the
+ * element with the same index in `orange`, i.e. `orange[i] = func(irange[i])`.
+ * The work is split and executed like in ostd::parallel_for_each().
+ *
+ * Both ranges must be at least ostd::finite_random_access_range_tag and
+ * `orange` has to be at least as long as `irange`. Unlike with ostd::map(),
+ * the result is computed eagerly.
+ *
+ * @returns The part of `orange` following the last written element.
+ *
+ * @see ostd::map()
+ */
+template<
+    typename Executor, typename FiniteRandomRange1,
+    typename FiniteRandomRange2, typename UnaryFunction
+>
+inline FiniteRandomRange2 parallel_transform(
+    Executor &exec, FiniteRandomRange1 irange, FiniteRandomRange2 orange,
+    UnaryFunction func, range_size_t<FiniteRandomRange1> grain = 0
+) {
+    using S = range_size_t<FiniteRandomRange1>;
+    S n = irange.size();
+    auto f = [&irange, &orange, &func](S, S b, S e) {
+        for (S i = b; i < e; ++i) {
+            orange[i] = func(irange[i]);
+        }
+    };
+    detail::par_run(exec, n, detail::par_grain(n, grain), f);
+    return orange.slice(n, orange.size());
+}
+
+/** @brief A pipeable version of ostd::parallel_transform().
+ *
+ * The executor is taken by reference, the `orange` and `func` are forwarded.
+ */
+template<typename Executor, typename FiniteRandomRange, typename UnaryFunction>
+inline auto parallel_transform(
+    Executor &exec, FiniteRandomRange &&orange, UnaryFunction &&func
+) {
+    return [
+        &exec, orange = std::forward<FiniteRandomRange>(orange),
+        func = std::forward<UnaryFunction>(func)
+    ](auto &obj) mutable {
+        return parallel_transform(
+            exec, obj, std::forward<FiniteRandomRange>(orange),
+            std::forward<UnaryFunction>(func)
+        );
+    };
+}
+
+/** @brief Counts the number of elements matching `pred` in parallel.
+ *
+ * Every chunk is counted by ostd::count_if() and the results are summed.
+ * The work is split and executed like in ostd::parallel_for_each().
+ *
+ * The range must be at least ostd::finite_random_access_range_tag.
+ *
+ * @see ostd::count_if()
+ */
+template<typename Executor, typename FiniteRandomRange, typename Predicate>
+inline range_size_t<FiniteRandomRange> parallel_count_if(
+    Executor &exec, FiniteRandomRange range, Predicate pred,
+    range_size_t<FiniteRandomRange> grain = 0
+) {
+    using S = range_size_t<FiniteRandomRange>;
+    S n = range.size();
+    std::atomic<S> ret = 0;
+    auto f = [&range, &pred, &ret](S, S b, S e) {
+        ret += count_if(range.slice(b, e), std::ref(pred));
+    };
+    detail::par_run(exec, n, detail::par_grain(n, grain), f);
+    return ret;
+}
+
+/** @brief A pipeable version of ostd::parallel_count_if().
+ *
+ * The executor is taken by reference, the `pred` is forwarded.
+ */
+template<typename Executor, typename Predicate>
+inline auto parallel_count_if(Executor &exec, Predicate &&pred) {
+    return [&exec, pred = std::forward<Predicate>(pred)](auto &obj) mutable {
+        return parallel_count_if(exec, obj, std::forward<Predicate>(pred));
+    };
+}
+
+/** @brief Finds the first element matching `pred` in parallel.
+ *
+ * The result is the same as with ostd::find_if(), i.e. the range starting
+ * with the first matching element or an empty range. The chunks are
+ * searched like in ostd::parallel_for_each(), but once a match is found,
+ * the chunks past it stop searching.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag.
+ *
+ * @see ostd::find_if()
+ */
+template<typename Executor, typename FiniteRandomRange, typename Predicate>
+inline FiniteRandomRange parallel_find_if(
+    Executor &exec, FiniteRandomRange range, Predicate pred,
+    range_size_t<FiniteRandomRange> grain = 0
+) {
+    using S = range_size_t<FiniteRandomRange>;
+    S n = range.size();
+    std::atomic<S> found = n;
+    auto f = [&range, &pred, &found](S, S b, S e) {
+        for (S i = b; i < e; ++i) {
+            S cur = found.load(std::memory_order_relaxed);
+            if (i >= cur) {
+                return;
+            }
+            if (pred(range[i])) {
+                while ((i < cur) && !found.compare_exchange_weak(cur, i));
+                return;
+            }
+        }
+    };
+    detail::par_run(exec, n, detail::par_grain(n, grain), f);
+    return range.slice(found, n);
+}
+
+/** @brief A pipeable version of ostd::parallel_find_if().
+ *
+ * The executor is taken by reference, the `pred` is forwarded.
+ */
+template<typename Executor, typename Predicate>
+inline auto parallel_find_if(Executor &exec, Predicate &&pred) {
+    return [&exec, pred = std::forward<Predicate>(pred)](auto &obj) mutable {
+        return parallel_find_if(exec, obj, std::forward<Predicate>(pred));
+    };
+}
+
+namespace detail {
+    /* below this many elements it's not worth sorting in parallel at all */
+    constexpr std::size_t PAR_SORT_MIN = 1 << 15;
+    /* partitions are never split into chunks smaller than this */
+    constexpr std::size_t PAR_SORT_GRAIN = 1 << 12;
+
+    /* partitions the whole range by pred in parallel; every chunk is
+     * partitioned on its own first, then the elements that ended up on
+     * the wrong side of the global split point are swapped pairwise,
+     * again in chunks; returns the number of elements matching pred
+     */
+    template<typename E, typename R, typename P>
+    inline range_size_t<R> par_partition(E &exec, R range, P &pred) {
+        using S = range_size_t<R>;
+        S n = range.size();
+        S grain = std::max(par_grain(n, S(0)), S(PAR_SORT_GRAIN));
+        std::vector<S> counts((n + grain - 1) / grain);
+        auto pf = [&range, &pred, &counts](S ci, S b, S e) {
+            auto r = range.slice(b, e);
+            counts[ci] = r.size() - partition(r, std::ref(pred)).size();
+        };
+        par_run(exec, n, grain, pf);
+        S split = 0;
+        for (S c: counts) {
+            split += c;
+        }
+        /* misplaced non-matching elements before the split and misplaced
+         * matching elements after it, as [begin, end) intervals along with
+         * the running total of elements before each interval; a chunk that
+         * has nothing misplaced must not get an empty one, as the swapping
+         * only ever steps over a single interval boundary at a time
+         */
+        struct ival {
+            S off, beg, end;
+        };
+        std::vector<ival> lhs, rhs;
+        S nl = 0, nr = 0;
+        for (S ci = 0; ci < S(counts.size()); ++ci) {
+            S b = ci * grain, e = std::min(n, b + grain), m = b + counts[ci];
+            if (m < split) {
+                S ie = std::min(e, split);
+                if (m < ie) {
+                    lhs.push_back(ival{nl, m, ie});
+                    nl += ie - m;
+                }
+            } else if (m > split) {
+                S ib = std::max(b, split);
+                if (ib < m) {
+                    rhs.push_back(ival{nr, ib, m});
+                    nr += m - ib;
+                }
+            }
+        }
+        auto find = [](std::vector<ival> &iv, S off) {
+            return std::upper_bound(
+                iv.begin(), iv.end(), off, [](S o, ival const &v) {
+                    return o < v.off;
+                }
+            ) - 1;
+        };
+        auto sf = [&range, &lhs, &rhs, &find](S, S b, S e) {
+            auto li = find(lhs, b), ri = find(rhs, b);
+            S lp = li->beg + (b - li->off), rp = ri->beg + (b - ri->off);
+            for (S i = b; i < e; ++i) {
+                if (lp == li->end) {
+                    lp = (++li)->beg;
+                }
+                if (rp == ri->end) {
+                    rp = (++ri)->beg;
+                }
+                using std::swap;
+                swap(range[lp++], range[rp++]);
+            }
+        };
+        par_run(exec, nl, grain, sf);
+        return split;
+    }
+
+    template<typename E, typename R, typename C>
+    inline void par_sort(E &exec, R range, C &compare) {
+        using S = range_size_t<R>;
+        S n = range.size();
+        if (n <= PAR_SORT_MIN) {
+            detail::pdqsort(range, compare);
+            return;
+        }
+        /* partition the range in parallel until the pieces are small
+         * enough for a few of them to go to every thread, then sort
+         * each piece sequentially in a separate task
+         */
+        S nthr = S(std::max(std::thread::hardware_concurrency(), 1U));
+        S cutoff = std::max(n / (nthr * 8), S(PAR_SORT_GRAIN));
+        S maxd = S(2 * detail::pdq_log2(n));
+        std::vector<std::pair<R, S>> work;
+        std::vector<R> pieces;
+        work.emplace_back(range, 0);
+        while (!work.empty()) {
+            auto [r, d] = work.back();
+            work.pop_back();
+            S m = r.size();
+            if ((m <= cutoff) || (d >= maxd)) {
+                if (m > 1) {
+                    pieces.push_back(r);
+                }
+                continue;
+            }
+            using std::swap;
+            /* median of three goes to the front and stays there */
+            S mid = m / 2;
+            if (compare(r[mid], r[0])) {
+                swap(r[mid], r[0]);
+            }
+            if (compare(r[m - 1], r[mid])) {
+                swap(r[m - 1], r[mid]);
+                if (compare(r[mid], r[0])) {
+                    swap(r[mid], r[0]);
+                }
+            }
+            swap(r[0], r[mid]);
+            auto &pivot = r[0];
+            auto lt = [&compare, &pivot](auto &&v) {
+                return compare(v, pivot);
+            };
+            S split = par_partition(exec, r.slice(1, m), lt);
+            if (!split) {
+                /* nothing is smaller than the pivot, so take everything
+                 * that is equal to it out of the way, that part is done
+                 */
+                auto le = [&compare, &pivot](auto &&v) {
+                    return !compare(pivot, v);
+                };
+                split = par_partition(exec, r.slice(1, m), le);
+                work.emplace_back(r.slice(split + 1, m), d + 1);
+                continue;
+            }
+            swap(r[0], r[split]);
+            work.emplace_back(r.slice(0, split), d + 1);
+            work.emplace_back(r.slice(split + 1, m), d + 1);
+        }
+        /* biggest pieces first so that the tail is made of small ones */
+        std::sort(pieces.begin(), pieces.end(), [](R const &a, R const &b) {
+            return a.size() > b.size();
+        });
+        auto sf = [&pieces, &compare](S, S b, S e) {
+            for (S i = b; i < e; ++i) {
+                detail::pdqsort(pieces[i], compare);
+            }
+        };
+        par_run(exec, S(pieces.size()), S(1), sf);
+    }
+} /* namespace detail */
+
+/** @brief Sorts a range in parallel given a comparison function.
+ *
+ * This is the parallel counterpart of ostd::sort_cmp(). The range is
+ * partitioned around median-of-three pivots, with every partitioning
+ * pass itself split into chunks that run on the given executor, until
+ * the parts are small enough; the parts are then sorted by the regular
+ * sequential algorithm, again in parallel. Ranges too small to benefit
+ * from this are simply sorted sequentially on the calling thread.
+ *
+ * The executor is an ostd::thread_pool or a scheduler, just like with
+ * ostd::parallel_for_each(), and the same restrictions apply. The
+ * comparison function is shared by all threads, so it has to be safe
+ * to call concurrently.
+ *
+ * The range must be at least ostd::finite_random_access_range_tag and
+ * it must meet the conditions of ostd::is_range_element_swappable. The
+ * sort is not stable.
+ *
+ * @see ostd::parallel_sort(), ostd::sort_cmp()
+ */
+template<typename Executor, typename FiniteRandomRange, typename Compare>
+inline FiniteRandomRange parallel_sort_cmp(
+    Executor &exec, FiniteRandomRange range, Compare compare
+) {
+    static_assert(
+        is_range_element_swappable<FiniteRandomRange>,
+        "The range element accessors must allow swapping"
+    );
+    detail::par_sort(exec, range, compare);
+    return range;
+}
+
+/** @brief A pipeable version of ostd::parallel_sort_cmp().
+ *
+ * The executor is taken by reference, the comparison function is forwarded.
+ */
+template<typename Executor, typename Compare>
+inline auto parallel_sort_cmp(Executor &exec, Compare &&compare) {
+    return [
+        &exec, compare = std::forward<Compare>(compare)
+    ](auto &obj) mutable {
+        return parallel_sort_cmp(exec, obj, std::forward<Compare>(compare));
+    };
+}
+
+/** @brief Like ostd::parallel_sort_cmp() using `std::less`. */
+template<typename Executor, typename FiniteRandomRange>
+inline FiniteRandomRange parallel_sort(
+    Executor &exec, FiniteRandomRange range
+) {
+    return parallel_sort_cmp(
+        exec, range, std::less<range_value_t<FiniteRandomRange>>{}
+    );
+}
+
+/** @brief A pipeable version of ostd::parallel_sort(). */
+template<typename Executor>
+inline auto parallel_sort(Executor &exec) {
+    return [&exec](auto &obj) { return parallel_sort(exec, obj); };
+}
+
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using ostd::test::fail_if_not;
+    thread_pool tp;
+    tp.start(4);
+    std::vector<int> v(1000);
+    iota(iter(v), 0);
+    /* small grain so that every worker gets something */
+    parallel_for_each(tp, iter(v), [](int &i) { i *= 2; }, 16);
+    fail_if(v[999] != 1998);
+    fail_if(parallel_reduce(tp, iter(v), 0, 16) != 999000);
+    fail_if((iter(v) | parallel_reduce(tp, 0)) != 999000);
+    fail_if((iter(v) | parallel_reduce_f(tp, 0, [](int a, int b) {
+        return std::max(a, b);
+    })) != 1998);
+    std::vector<int> o(1000);
+    auto rest = parallel_transform(tp, iter(v), iter(o), [](int i) {
+        return i + 1;
+    }, 16);
+    fail_if_not(rest.empty());
+    fail_if(o[0] != 1 || o[999] != 1999);
+    fail_if(parallel_count_if(tp, iter(v), [](int i) {
+        return i % 4 == 0;
+    }, 16) != 500);
+    auto fr = iter(v) | parallel_find_if(tp, [](int i) { return i > 500; });
+    fail_if(fr.size() != 749 || fr.front() != 502);
+    fail_if_not(parallel_find_if(tp, iter(v), [](int i) {
+        return i < 0;
+    }, 16).empty());
+    bool thrown = false;
+    try {
+        parallel_for_each(tp, iter(v), [](int i) {
+            if (i == 1000) {
+                throw i;
+            }
+        }, 16);
+    } catch (int) {
+        thrown = true;
+    }
+    fail_if_not(thrown);
+}
+#endif
+
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using ostd::test::fail_if_not;
+    thread_pool tp;
+    tp.start(4);
+    auto sorted = [](auto &v) {
+        for (std::size_t i = 1; i < v.size(); ++i) {
+            if (v[i] < v[i - 1]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    std::vector<unsigned> v(200000);
+    unsigned x = 12345;
+    /* pseudorandom, then few distinct values, then already sorted */
+    for (auto &i: v) {
+        x = x * 1103515245 + 12345;
+        i = x >> 8;
+    }
+    auto sum = foldl(iter(v), 0ULL);
+    parallel_sort(tp, iter(v));
+    fail_if_not(sorted(v));
+    fail_if(foldl(iter(v), 0ULL) != sum);
+    for (auto &i: v) {
+        i %= 3;
+    }
+    iter(v) | parallel_sort(tp);
+    fail_if_not(sorted(v));
+    parallel_sort_cmp(tp, iter(v), std::greater<unsigned>{});
+    fail_if(v.front() != 2 || v.back() != 0);
+    iota(iter(v), 0U);
+    iter(v) | parallel_sort_cmp(tp, std::greater<unsigned>{});
+    fail_if(v.front() != 199999 || v.back() != 0);
+    /* patterns where whole chunks end up on the right side of a split */
+    auto check = [&v, &tp]() {
+        std::vector<unsigned> w = v;
+        std::sort(w.begin(), w.end());
+        parallel_sort(tp, iter(v));
+        return v == w;
+    };
+    for (std::size_t n: {100000, 1000000}) {
+        v.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            v[i] = unsigned((i < (n / 2)) ? i : (n - i));
+        }
+        fail_if_not(check());
+        iota(iter(v), 0U);
+        for (int i = 0; i < 50; ++i) {
+            x = x * 1103515245 + 12345;
+            std::size_t a = (x >> 8) % n;
+            x = x * 1103515245 + 12345;
+            std::swap(v[a], v[(x >> 8) % n]);
+        }
+        fail_if_not(check());
+    }
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
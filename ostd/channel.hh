@@ -4,10 +4,11 @@
 
 /** @file channel.hh
  *
- * @brief Thread-safe queue for cross-task data transfer.
+ * @brief Thread-safe queues for cross-task data transfer.
  *
  * This file implements channels, a kind of thread-safe queue that can be
- * used to send and receive values across tasks safely.
+ * used to send and receive values across tasks safely. There are both
+ * unbounded and bounded channels.
  *
  * @copyright See COPYING.md in the project tree for further information.
  */
@@ -15,18 +16,33 @@
 #ifndef OSTD_CHANNEL_HH
 #define OSTD_CHANNEL_HH
 
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include <chrono>
 #include <type_traits>
 #include <optional>
 #include <algorithm>
+#include <iterator>
 #include <list>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <stdexcept>
 #include <memory>
 
+#ifdef OSTD_BUILD_TESTS
+#include <thread>
+#include <limits>
+#endif
+
+#include <ostd/unit_test.hh>
 #include <ostd/platform.hh>
 #include <ostd/generic_condvar.hh>
 
+#define OSTD_TEST_MODULE libostd_channel
+
 namespace ostd {
 
 /** @addtogroup Concurrency
@@ -40,6 +56,64 @@ struct OSTD_EXPORT channel_error: std::logic_error {
     virtual ~channel_error();
 };
 
+namespace detail {
+    /* a task waiting in ostd::select(); channels keep a list of these
+     * and signal all of them whenever they get a message or get closed,
+     * after releasing their own lock, as the signal may switch tasks
+     */
+    struct chan_selector {
+        template<typename F>
+        chan_selector(F &func): p_cond(func()) {}
+
+        void signal() {
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                p_ready = true;
+            }
+            p_cond.notify_one();
+        }
+
+        void wait() {
+            detail::cancel_scope cs{p_lock, p_cond};
+            std::unique_lock<std::mutex> l{p_lock};
+            while (!p_ready) {
+                if (cs.can_wait(l)) {
+                    p_cond.wait(l);
+                }
+            }
+            p_ready = false;
+        }
+
+    private:
+        std::mutex p_lock;
+        generic_condvar p_cond;
+        bool p_ready = false;
+    };
+
+    using chan_selectors = std::vector<std::shared_ptr<chan_selector>>;
+
+    inline void chan_signal(chan_selectors const &sels) {
+        for (auto &s: sels) {
+            s->signal();
+        }
+    }
+
+    inline void chan_remove_selector(
+        chan_selectors &sels, chan_selector *sel
+    ) {
+        sels.erase(std::find_if(sels.begin(), sels.end(), [sel](auto &p) {
+            return p.get() == sel;
+        }));
+    }
+
+    struct chan_access {
+        template<typename C>
+        static auto &state(C &ch) noexcept {
+            return *ch.p_state;
+        }
+    };
+} /* namespace detail */
+
 /** @brief A thread-safe message queue.
  *
  * A channel is a kind of message queue (FIFO) that is properly synchronized.
@@ -57,6 +131,10 @@ struct OSTD_EXPORT channel_error: std::logic_error {
  * the reference count, so both instances point to the ssame state and
  * both are valid.
  *
+ * Any wait on a channel is a cancellation point; a task of a cancelled
+ * ostd::task_group gets ostd::task_cancelled thrown out of a get() that
+ * would have to wait, instead of waiting.
+ *
  * @tparam T The type of the values in the queue.
  */
 template<typename T>
@@ -151,10 +229,8 @@ struct channel {
      * @see try_get(), put(T const &), close(), closed()
      */
     T get() {
-        T ret;
-        /* guaranteed to return true if at all */
-        p_state->get(ret, true);
-        return ret;
+        /* guaranteed to return a value if at all */
+        return std::move(*p_state->get(true));
     }
 
     /** @brief Gets a value from the queue if there is one.
@@ -170,11 +246,92 @@ struct channel {
      * @see get(), put(T const &), close(), closed()
      */
     std::optional<T> try_get() {
-        T ret;
-        if (!p_state->get(ret, false)) {
-            return std::nullopt;
-        }
-        return std::move(ret);
+        return p_state->get(false);
+    }
+
+    /** @brief Waits for a value until the given time point.
+     *
+     * Like get(), but gives up once the deadline has passed, which does
+     * not block the thread when called within a coroutine based scheduler.
+     *
+     * @returns The value or std::nullopt if there wasn't one in time.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     *
+     * @see try_get_for(), get(), try_get()
+     */
+    template<typename C, typename D>
+    std::optional<T> try_get_until(std::chrono::time_point<C, D> const &tp) {
+        return p_state->get_until(detail::steady_deadline(tp));
+    }
+
+    /** @brief Waits for a value for at most the given duration.
+     *
+     * See try_get_until().
+     */
+    template<typename R, typename P>
+    std::optional<T> try_get_for(std::chrono::duration<R, P> const &dur) {
+        return p_state->get_until(detail::steady_deadline(dur));
+    }
+
+    /** @brief Inserts all values of a range into the queue at once.
+     *
+     * The values are first copied (or moved, when the range yields rvalue
+     * references) out of the range without holding the channel lock, and
+     * then appended to the queue in one step, so other tasks will never
+     * see only a part of them. Tasks waiting on the queue are notified
+     * once afterwards.
+     *
+     * @param[in] range The input range.
+     *
+     * @returns The number of inserted values.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     *
+     * @see put(T const &), get_n()
+     */
+    template<typename InputRange>
+    std::size_t put_range(InputRange range) {
+        return p_state->put_range(range);
+    }
+
+    /** @brief Waits for values and writes up to `max` of them to a range.
+     *
+     * Like get(), this blocks the calling task if the queue is empty. Once
+     * there is at least one value, as many values as are available (but
+     * at most @p max) are taken out of the queue at once and then moved
+     * into the output range, after the lock has been released. The output
+     * range is taken by reference, so an appender can be passed directly.
+     *
+     * @param[in] out The output range.
+     * @param[in] max The maximum number of values.
+     *
+     * @returns The number of values written, never 0 unless @p max is 0.
+     *
+     * @throws ostd::channel_error when the channel is closed and empty.
+     *
+     * @see get(), drain(), put_range()
+     */
+    template<typename OutputRange>
+    std::size_t get_n(OutputRange &&out, std::size_t max) {
+        return p_state->get_n(out, max, true);
+    }
+
+    /** @brief Moves all values currently in the queue to a range.
+     *
+     * This doesn't block, and unlike try_get() it doesn't throw when the
+     * channel is closed, so it can be used to collect the leftovers after
+     * closing it. Otherwise it works like get_n().
+     *
+     * @param[in] out The output range.
+     *
+     * @returns The number of values written.
+     *
+     * @see get_n(), try_get()
+     */
+    template<typename OutputRange>
+    std::size_t drain(OutputRange &&out) {
+        return p_state->get_n(out, std::size_t(-1), false);
     }
 
     /** @brief Checks if the channel is empty.
@@ -205,6 +362,8 @@ struct channel {
     }
 
 private:
+    friend struct detail::chan_access;
+
     struct impl {
         impl() {
         }
@@ -214,44 +373,142 @@ private:
 
         template<typename U>
         void put(U &&val) {
+            detail::chan_selectors sels;
             {
                 std::lock_guard<std::mutex> l{p_lock};
                 if (p_closed) {
                     throw channel_error{"put in a closed channel"};
                 }
                 p_messages.push_back(std::forward<U>(val));
+                if (!p_selectors.empty()) {
+                    sels = p_selectors;
+                }
             }
             p_cond.notify_one();
+            detail::chan_signal(sels);
         }
 
         template<typename ...A>
         void emplace(A &&...args) {
+            detail::chan_selectors sels;
             {
                 std::lock_guard<std::mutex> l{p_lock};
                 if (p_closed) {
                     throw channel_error{"emplace in a closed channel"};
                 }
-                p_messages.emplace(std::forward<A>(args)...);
+                p_messages.emplace_back(std::forward<A>(args)...);
+                if (!p_selectors.empty()) {
+                    sels = p_selectors;
+                }
             }
             p_cond.notify_one();
+            detail::chan_signal(sels);
         }
 
-        bool get(T &val, bool w) {
+        template<typename R>
+        std::size_t put_range(R &range) {
+            std::list<T> msgs;
+            for (; !range.empty(); range.pop_front()) {
+                msgs.emplace_back(range.front());
+            }
+            std::size_t n = msgs.size();
+            if (!n) {
+                return 0;
+            }
+            detail::chan_selectors sels;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                if (p_closed) {
+                    throw channel_error{"put in a closed channel"};
+                }
+                p_messages.splice(p_messages.end(), msgs);
+                if (!p_selectors.empty()) {
+                    sels = p_selectors;
+                }
+            }
+            if (n > 1) {
+                p_cond.notify_all();
+            } else {
+                p_cond.notify_one();
+            }
+            detail::chan_signal(sels);
+            return n;
+        }
+
+        std::optional<T> get(bool w) {
+            detail::cancel_scope cs{p_lock, p_cond};
             std::unique_lock<std::mutex> l{p_lock};
             if (w) {
                 while (!p_closed && p_messages.empty()) {
-                    p_cond.wait(l);
+                    if (cs.can_wait(l)) {
+                        p_cond.wait(l);
+                    }
+                }
+            }
+            return pop();
+        }
+
+        std::optional<T> get_until(
+            std::chrono::steady_clock::time_point const &tp
+        ) {
+            detail::cancel_scope cs{p_lock, p_cond};
+            std::unique_lock<std::mutex> l{p_lock};
+            while (!p_closed && p_messages.empty()) {
+                if (!cs.can_wait(l)) {
+                    continue;
+                }
+                if (p_cond.wait_until(l, tp) == std::cv_status::timeout) {
+                    break;
                 }
             }
+            return pop();
+        }
+
+        /* called with the lock held */
+        std::optional<T> pop() {
             if (p_messages.empty()) {
                 if (p_closed) {
                     throw channel_error{"get from a closed channel"};
                 }
-                return false;
+                return std::nullopt;
             }
-            val = std::move(p_messages.front());
+            std::optional<T> ret{std::move(p_messages.front())};
             p_messages.pop_front();
-            return true;
+            return ret;
+        }
+
+        /* takes the messages out while locked, hands them out unlocked */
+        template<typename R>
+        std::size_t get_n(R &out, std::size_t max, bool w) {
+            if (!max) {
+                return 0;
+            }
+            std::list<T> msgs;
+            {
+                detail::cancel_scope cs{p_lock, p_cond};
+                std::unique_lock<std::mutex> l{p_lock};
+                if (w) {
+                    while (!p_closed && p_messages.empty()) {
+                        if (cs.can_wait(l)) {
+                            p_cond.wait(l);
+                        }
+                    }
+                    if (p_messages.empty()) {
+                        throw channel_error{"get from a closed channel"};
+                    }
+                }
+                auto it = p_messages.begin();
+                if (max >= p_messages.size()) {
+                    it = p_messages.end();
+                } else {
+                    std::advance(it, max);
+                }
+                msgs.splice(msgs.end(), p_messages, p_messages.begin(), it);
+            }
+            for (auto &v: msgs) {
+                out.put(std::move(v));
+            }
+            return msgs.size();
         }
 
         bool empty() const noexcept {
@@ -265,14 +522,35 @@ private:
         }
 
         void close() noexcept {
+            detail::chan_selectors sels;
             {
                 std::lock_guard<std::mutex> l{p_lock};
                 p_closed = true;
+                sels.swap(p_selectors);
             }
             p_cond.notify_all();
+            detail::chan_signal(sels);
+        }
+
+        /* registers the selector and tells whether select can return */
+        bool add_selector(std::shared_ptr<detail::chan_selector> const &sel) {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (p_closed || !p_messages.empty()) {
+                return true;
+            }
+            p_selectors.push_back(sel);
+            return false;
+        }
+
+        void remove_selector(detail::chan_selector *sel) {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (!p_closed) {
+                detail::chan_remove_selector(p_selectors, sel);
+            }
         }
 
         std::list<T> p_messages;
+        detail::chan_selectors p_selectors;
         mutable std::mutex p_lock;
         generic_condvar p_cond;
         bool p_closed = false;
@@ -282,10 +560,662 @@ private:
     std::shared_ptr<impl> p_state;
 };
 
+/** @brief A thread-safe bounded message queue.
+ *
+ * This is a variant of ostd::channel with a fixed capacity. The messages
+ * are stored in a ring buffer that is allocated upfront, and putting and
+ * getting messages is lock-free (a multi-producer multi-consumer queue
+ * with a sequence number in every slot, after Dmitry Vyukov's design),
+ * so there are no allocations and no global lock in the common case.
+ *
+ * When the channel is full, put() blocks until there is space, and when
+ * it is empty, get() blocks until there is a message. Blocking is done
+ * with ostd::generic_condvar just like with ostd::channel, so tasks of
+ * coroutine based schedulers are suspended rather than spinning; the
+ * lock and condition variables are only touched when somebody is or may
+ * be waiting.
+ *
+ * The reference counting and cancellation semantics are the same as with
+ * ostd::channel; both put() and get() are cancellation points when they
+ * would have to wait.
+ *
+ * @tparam T The type of the values in the queue; it needs to be nothrow
+ *           move constructible.
+ */
+template<typename T>
+struct bounded_channel {
+    static_assert(
+        std::is_nothrow_move_constructible_v<T>,
+        "bounded channel values must be nothrow move constructible"
+    );
+
+    /** @brief Constructs a bounded channel with the given capacity.
+     *
+     * The capacity is rounded up to a power of two (at least 2). Like
+     * with ostd::channel(), std::condition_variable is used to block.
+     *
+     * @throws std::length_error when @p cap is above the largest power
+     * of two `std::size_t` can hold.
+     *
+     * @see ostd::make_bounded_channel(), bounded_channel(std::size_t, F)
+     */
+    bounded_channel(std::size_t cap):
+        p_state(new impl{cap, []() { return generic_condvar{}; }})
+    {}
+
+    /** @brief Constructs a bounded channel with a custom condvar type.
+     *
+     * Works like ostd::channel::channel(F), but the function is called
+     * twice, as the channel waits for space and for values separately.
+     */
+    template<typename F>
+    bounded_channel(std::size_t cap, F func): p_state(new impl{cap, func}) {}
+
+    bounded_channel(bounded_channel const &) = default;
+    bounded_channel(bounded_channel &&) = default;
+    bounded_channel &operator=(bounded_channel const &) = default;
+    bounded_channel &operator=(bounded_channel &&) = default;
+
+    /** @brief Inserts a copy of a value into the queue.
+     *
+     * If the queue is full, this blocks the calling task until there is
+     * space. Afterwards, a single task waiting in get() is notified.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     *
+     * @see try_put(), get(), close()
+     */
+    void put(T const &val) {
+        p_state->put(val);
+    }
+
+    /** @brief Like put(T const &), but moves the value. */
+    void put(T &&val) {
+        p_state->put(std::move(val));
+    }
+
+    /** @brief Like put(), but constructs the element from arguments.
+     *
+     * The element is constructed first and then moved into the queue.
+     */
+    template<typename ...A>
+    void emplace(A &&...args) {
+        p_state->put(T(std::forward<A>(args)...));
+    }
+
+    /** @brief Inserts a copy of a value into the queue if there is space.
+     *
+     * @returns `true` if the value was inserted, `false` if full.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     */
+    bool try_put(T const &val) {
+        return p_state->try_put(val);
+    }
+
+    /** @brief Like try_put(T const &), but moves the value. */
+    bool try_put(T &&val) {
+        return p_state->try_put(std::move(val));
+    }
+
+    /** @brief Inserts a copy of a value, waiting for space until a deadline.
+     *
+     * Like put(T const &), but gives up once the deadline has passed.
+     *
+     * @returns `true` if the value was inserted, `false` on timeout.
+     *
+     * @throws ostd::channel_error when the channel is closed.
+     *
+     * @see try_put_for(), put(), try_put()
+     */
+    template<typename C, typename D>
+    bool try_put_until(
+        T const &val, std::chrono::time_point<C, D> const &tp
+    ) {
+        return p_state->put_until(val, detail::steady_deadline(tp));
+    }
+
+    /** @brief Like try_put_until(T const &), but moves the value.
+     *
+     * The value is only moved from when it's inserted.
+     */
+    template<typename C, typename D>
+    bool try_put_until(T &&val, std::chrono::time_point<C, D> const &tp) {
+        return p_state->put_until(std::move(val), detail::steady_deadline(tp));
+    }
+
+    /** @brief Like try_put_until(T const &), but with a duration. */
+    template<typename R, typename P>
+    bool try_put_for(T const &val, std::chrono::duration<R, P> const &dur) {
+        return p_state->put_until(val, detail::steady_deadline(dur));
+    }
+
+    /** @brief Like try_put_for(T const &), but moves the value. */
+    template<typename R, typename P>
+    bool try_put_for(T &&val, std::chrono::duration<R, P> const &dur) {
+        return p_state->put_until(
+            std::move(val), detail::steady_deadline(dur)
+        );
+    }
+
+    /** @brief Waits for a value and returns it.
+     *
+     * If the queue is empty, this blocks the calling task until there is
+     * a value. Afterwards, a single task waiting in put() is notified.
+     * Values put before the channel was closed can still be retrieved.
+     *
+     * @throws ostd::channel_error when the channel is closed and empty.
+     *
+     * @see try_get(), put(), close()
+     */
+    T get() {
+        return p_state->get();
+    }
+
+    /** @brief Gets a value from the queue if there is one.
+     *
+     * @returns The value or std::nullopt if there isn't one.
+     *
+     * @throws ostd::channel_error when the channel is closed and empty.
+     */
+    std::optional<T> try_get() {
+        return p_state->try_get();
+    }
+
+    /** @brief Waits for a value until the given time point.
+     *
+     * Like get(), but gives up once the deadline has passed.
+     *
+     * @returns The value or std::nullopt if there wasn't one in time.
+     *
+     * @throws ostd::channel_error when the channel is closed and empty.
+     *
+     * @see try_get_for(), get(), try_get()
+     */
+    template<typename C, typename D>
+    std::optional<T> try_get_until(std::chrono::time_point<C, D> const &tp) {
+        return p_state->get_until(detail::steady_deadline(tp));
+    }
+
+    /** @brief Waits for a value for at most the given duration.
+     *
+     * See try_get_until().
+     */
+    template<typename R, typename P>
+    std::optional<T> try_get_for(std::chrono::duration<R, P> const &dur) {
+        return p_state->get_until(detail::steady_deadline(dur));
+    }
+
+    /** @brief Checks if the channel is empty.
+     *
+     * Like with ostd::channel, a closed channel is considered empty. The
+     * result is only a snapshot when other tasks use the channel.
+     */
+    bool empty() const noexcept {
+        return p_state->empty();
+    }
+
+    /** @brief Checks if the channel is closed. */
+    bool closed() const noexcept {
+        return p_state->p_closed.load();
+    }
+
+    /** @brief Closes the channel. No effect if already closed.
+     *
+     * All tasks blocked in put() or get() are woken up.
+     */
+    void close() noexcept {
+        p_state->close();
+    }
+
+    /** @brief Gets the capacity of the channel. */
+    std::size_t capacity() const noexcept {
+        return p_state->p_mask + 1;
+    }
+
+private:
+    friend struct detail::chan_access;
+
+    struct impl {
+        struct slot {
+            std::atomic<std::size_t> p_seq;
+            std::aligned_storage_t<sizeof(T), alignof(T)> p_value;
+
+            T *value() noexcept {
+                return std::launder(reinterpret_cast<T *>(&p_value));
+            }
+        };
+
+        template<typename F>
+        impl(std::size_t cap, F func):
+            p_mask{ceil_pow2(cap) - 1}, p_slots{new slot[p_mask + 1]},
+            p_notempty(func()), p_notfull(func())
+        {
+            for (std::size_t i = 0; i <= p_mask; ++i) {
+                p_slots[i].p_seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~impl() {
+            while (pop()) {}
+        }
+
+        static std::size_t ceil_pow2(std::size_t n) {
+            constexpr std::size_t top = ~(~std::size_t(0) >> 1);
+            if (n > top) {
+                throw std::length_error{"bounded channel capacity too large"};
+            }
+            std::size_t ret = 2;
+            while (ret < n) {
+                ret <<= 1;
+            }
+            return ret;
+        }
+
+        template<typename U>
+        bool push(U &&val) {
+            std::size_t pos = p_head.load(std::memory_order_relaxed);
+            slot *s;
+            for (;;) {
+                s = &p_slots[pos & p_mask];
+                auto seq = s->p_seq.load(std::memory_order_acquire);
+                auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+                if (diff == 0) {
+                    if (p_head.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed
+                    )) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    /* the slot still holds the value from the last lap */
+                    return false;
+                } else {
+                    pos = p_head.load(std::memory_order_relaxed);
+                }
+            }
+            new (&s->p_value) T(std::forward<U>(val));
+            s->p_seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        std::optional<T> pop() {
+            std::size_t pos = p_tail.load(std::memory_order_relaxed);
+            slot *s;
+            for (;;) {
+                s = &p_slots[pos & p_mask];
+                auto seq = s->p_seq.load(std::memory_order_acquire);
+                auto diff = std::intptr_t(seq) - std::intptr_t(pos + 1);
+                if (diff == 0) {
+                    if (p_tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed
+                    )) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    /* nothing has been put in the slot yet */
+                    return std::nullopt;
+                } else {
+                    pos = p_tail.load(std::memory_order_relaxed);
+                }
+            }
+            std::optional<T> ret{std::move(*s->value())};
+            s->value()->~T();
+            s->p_seq.store(pos + p_mask + 1, std::memory_order_release);
+            return ret;
+        }
+
+        /* the waiter counts make an eventcount together with the lock;
+         * a waiter increments its count and then checks the queue again
+         * with the lock held, while the other side changes the queue and
+         * then checks the count, so at least one of them sees the other
+         */
+        void wake(std::atomic<std::size_t> &waiters, generic_condvar &cond) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!waiters.load(std::memory_order_relaxed)) {
+                return;
+            }
+            {
+                /* make sure the waiter is not between its check and wait */
+                std::lock_guard<std::mutex> l{p_lock};
+            }
+            cond.notify_one();
+        }
+
+        /* selectors count as waiting getters, so they're only looked
+         * up when that count says somebody may be waiting
+         */
+        void wake_getters() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!p_getters.load(std::memory_order_relaxed)) {
+                return;
+            }
+            detail::chan_selectors sels;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                if (!p_selectors.empty()) {
+                    sels = p_selectors;
+                }
+            }
+            p_notempty.notify_one();
+            detail::chan_signal(sels);
+        }
+
+        template<typename U>
+        bool try_put(U &&val) {
+            if (p_closed.load()) {
+                throw channel_error{"put in a closed channel"};
+            }
+            if (!push(std::forward<U>(val))) {
+                return false;
+            }
+            wake_getters();
+            return true;
+        }
+
+        template<typename U>
+        void put(U &&val) {
+            put_wait(std::forward<U>(val), [this](auto &l) {
+                p_notfull.wait(l);
+                return true;
+            });
+        }
+
+        template<typename U>
+        bool put_until(
+            U &&val, std::chrono::steady_clock::time_point const &tp
+        ) {
+            return put_wait(std::forward<U>(val), [this, &tp](auto &l) {
+                return (
+                    p_notfull.wait_until(l, tp) != std::cv_status::timeout
+                );
+            });
+        }
+
+        /* the wait function returns false when the waiting should end;
+         * the queue still gets checked one last time in that case
+         */
+        template<typename U, typename W>
+        bool put_wait(U &&val, W wait) {
+            if (try_put(std::forward<U>(val))) {
+                return true;
+            }
+            detail::cancel_scope cs{p_lock, p_notfull};
+            cs.arm();
+            std::unique_lock<std::mutex> l{p_lock};
+            for (bool last = false;;) {
+                p_putters.fetch_add(1);
+                if (p_closed.load()) {
+                    p_putters.fetch_sub(1);
+                    throw channel_error{"put in a closed channel"};
+                }
+                if (push(std::forward<U>(val))) {
+                    p_putters.fetch_sub(1);
+                    break;
+                }
+                if (last || cs.cancelled()) {
+                    p_putters.fetch_sub(1);
+                    cs.check();
+                    return false;
+                }
+                last = !wait(l);
+                p_putters.fetch_sub(1);
+            }
+            l.unlock();
+            wake_getters();
+            return true;
+        }
+
+        std::optional<T> try_get() {
+            auto ret = pop();
+            if (ret) {
+                wake(p_putters, p_notfull);
+            } else if (p_closed.load()) {
+                /* values put before closing are still pending */
+                ret = pop();
+                if (!ret) {
+                    throw channel_error{"get from a closed channel"};
+                }
+            }
+            return ret;
+        }
+
+        T get() {
+            /* guaranteed to return a value if at all */
+            return std::move(*get_wait([this](auto &l) {
+                p_notempty.wait(l);
+                return true;
+            }));
+        }
+
+        std::optional<T> get_until(
+            std::chrono::steady_clock::time_point const &tp
+        ) {
+            return get_wait([this, &tp](auto &l) {
+                return (
+                    p_notempty.wait_until(l, tp) != std::cv_status::timeout
+                );
+            });
+        }
+
+        /* like put_wait, gives up when the wait function returns false */
+        template<typename W>
+        std::optional<T> get_wait(W wait) {
+            if (auto ret = try_get(); ret) {
+                return ret;
+            }
+            detail::cancel_scope cs{p_lock, p_notempty};
+            cs.arm();
+            std::unique_lock<std::mutex> l{p_lock};
+            for (bool last = false;;) {
+                p_getters.fetch_add(1);
+                if (auto ret = pop(); ret) {
+                    p_getters.fetch_sub(1);
+                    l.unlock();
+                    wake(p_putters, p_notfull);
+                    return ret;
+                }
+                if (p_closed.load()) {
+                    p_getters.fetch_sub(1);
+                    throw channel_error{"get from a closed channel"};
+                }
+                if (last || cs.cancelled()) {
+                    p_getters.fetch_sub(1);
+                    cs.check();
+                    return std::nullopt;
+                }
+                last = !wait(l);
+                p_getters.fetch_sub(1);
+            }
+        }
+
+        bool empty() const noexcept {
+            if (p_closed.load()) {
+                return true;
+            }
+            return p_head.load() == p_tail.load();
+        }
+
+        void close() noexcept {
+            detail::chan_selectors sels;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                p_closed.store(true);
+                sels.swap(p_selectors);
+                p_getters.fetch_sub(sels.size());
+            }
+            p_notempty.notify_all();
+            p_notfull.notify_all();
+            detail::chan_signal(sels);
+        }
+
+        bool ready() const noexcept {
+            std::size_t pos = p_tail.load();
+            return p_closed.load() || (
+                p_slots[pos & p_mask].p_seq.load() == (pos + 1)
+            );
+        }
+
+        bool add_selector(std::shared_ptr<detail::chan_selector> const &sel) {
+            std::lock_guard<std::mutex> l{p_lock};
+            p_getters.fetch_add(1);
+            if (ready()) {
+                p_getters.fetch_sub(1);
+                return true;
+            }
+            p_selectors.push_back(sel);
+            return false;
+        }
+
+        void remove_selector(detail::chan_selector *sel) {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (!p_closed.load()) {
+                detail::chan_remove_selector(p_selectors, sel);
+                p_getters.fetch_sub(1);
+            }
+        }
+
+        /* producers and consumers hammer different ends */
+        alignas(64) std::atomic<std::size_t> p_head{0};
+        alignas(64) std::atomic<std::size_t> p_tail{0};
+        alignas(64) std::size_t p_mask;
+        std::unique_ptr<slot[]> p_slots;
+        std::atomic<std::size_t> p_getters{0};
+        std::atomic<std::size_t> p_putters{0};
+        std::atomic<bool> p_closed{false};
+        detail::chan_selectors p_selectors;
+        mutable std::mutex p_lock;
+        generic_condvar p_notempty;
+        generic_condvar p_notfull;
+    };
+
+    std::shared_ptr<impl> p_state;
+};
+
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    std::pair<std::size_t, std::size_t> caps[] = {
+        { 1, 2 }, { 2, 2 }, { 3, 4 }, { 64, 64 }
+    };
+    for (auto [cap, rcap]: caps) {
+        constexpr int nthr = 4, nval = 20000;
+        bounded_channel<int> ch{cap};
+        fail_if_not(ch.capacity() == rcap);
+        std::atomic<int> count{0};
+        std::atomic<long long> sum{0};
+        std::vector<std::thread> prod, cons;
+        for (int i = 0; i < nthr; ++i) {
+            prod.emplace_back([ch, i]() mutable {
+                for (int j = 0; j < nval; ++j) {
+                    ch.put(i * nval + j);
+                }
+            });
+            cons.emplace_back([ch, &count, &sum]() mutable {
+                for (;;) {
+                    int v;
+                    try {
+                        v = ch.get();
+                    } catch (channel_error const &) {
+                        return;
+                    }
+                    count.fetch_add(1);
+                    sum.fetch_add(v);
+                }
+            });
+        }
+        for (auto &t: prod) {
+            t.join();
+        }
+        /* values put before closing are still handed out */
+        ch.close();
+        for (auto &t: cons) {
+            t.join();
+        }
+        long long total = nthr * nval;
+        fail_if_not(count == total);
+        fail_if_not(sum == total * (total - 1) / 2);
+    }
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using ostd::test::fail_if_not;
+    bounded_channel<int> ch{2};
+    fail_if(ch.try_get().has_value());
+    fail_if_not(ch.try_put(1));
+    fail_if_not(ch.try_put(2));
+    fail_if(ch.try_put(3));
+    fail_if(ch.try_put_for(3, std::chrono::milliseconds(1)));
+    fail_if_not(ch.try_get() == 1);
+    fail_if_not(ch.try_put(3));
+    fail_if_not(ch.get() == 2);
+    fail_if_not(ch.get() == 3);
+    fail_if(ch.try_get().has_value());
+    fail_if(ch.try_get_for(std::chrono::milliseconds(1)).has_value());
+    fail_if_not(ch.empty());
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    using namespace std::chrono_literals;
+    /* a put blocked on a full channel */
+    bounded_channel<int> full{2};
+    full.put(1);
+    full.put(2);
+    std::atomic<bool> pthrown{false};
+    std::thread pt{[full, &pthrown]() mutable {
+        try {
+            full.put(3);
+        } catch (channel_error const &) {
+            pthrown = true;
+        }
+    }};
+    /* a get blocked on an empty channel */
+    bounded_channel<int> empty{2};
+    std::atomic<bool> gthrown{false};
+    std::thread gt{[empty, &gthrown]() mutable {
+        try {
+            empty.get();
+        } catch (channel_error const &) {
+            gthrown = true;
+        }
+    }};
+    std::this_thread::sleep_for(20ms);
+    full.close();
+    empty.close();
+    pt.join();
+    gt.join();
+    fail_if_not(pthrown && gthrown);
+    /* what was put before closing can still be taken out */
+    fail_if_not(full.get() == 1);
+    fail_if_not(full.get() == 2);
+    bool thrown = false;
+    try {
+        full.get();
+    } catch (channel_error const &) {
+        thrown = true;
+    }
+    fail_if_not(thrown);
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    bool thrown = false;
+    try {
+        bounded_channel<int> ch{std::numeric_limits<std::size_t>::max()};
+    } catch (std::length_error const &) {
+        thrown = true;
+    }
+    fail_if_not(thrown);
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
 
+#undef OSTD_TEST_MODULE
+
 #endif
 
 /** @} */
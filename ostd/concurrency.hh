@@ -41,20 +41,34 @@
 #define OSTD_CONCURRENCY_HH
 
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <vector>
 #include <list>
+#include <map>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 #include <thread>
 #include <utility>
 #include <memory>
 #include <stdexcept>
 #include <exception>
+#include <tuple>
+#include <optional>
 #include <type_traits>
 
+#include <ostd/unit_test.hh>
 #include <ostd/platform.hh>
+#include <ostd/affinity.hh>
+#include <ostd/sched_stats.hh>
 #include <ostd/coroutine.hh>
 #include <ostd/channel.hh>
 #include <ostd/generic_condvar.hh>
 
+#define OSTD_TEST_MODULE libostd_concurrency
+
 namespace ostd {
 
 /** @addtogroup Concurrency
@@ -63,59 +77,163 @@ namespace ostd {
 
 struct scheduler;
 
+/** @brief Thrown out of a cancellation point of a cancelled task.
+ *
+ * Tasks spawned in an ostd::task_group that has been cancelled get this
+ * thrown out of their next cancellation point, which is ostd::yield(),
+ * ostd::cancellation_point() or a wait on a channel. It's not meant to
+ * be caught by the task itself; the group swallows it once it leaves
+ * the task.
+ *
+ * @see ostd::task_group
+ */
+struct OSTD_EXPORT task_cancelled: std::runtime_error {
+    /** @brief Constructs the exception. */
+    task_cancelled(): std::runtime_error{"task cancelled"} {}
+
+    /* empty, for vtable placement */
+    virtual ~task_cancelled();
+};
+
 namespace detail {
-    template<typename T>
-    struct tid_impl {
-        tid_impl() = delete;
+    /* something to be done once a task is finished, see tid_base */
+    struct OSTD_EXPORT tid_cont {
+        tid_cont() {}
+        /* empty, for vtable placement */
+        virtual ~tid_cont();
+
+        /* called exactly once, from whoever finished the task */
+        virtual void ready() noexcept = 0;
+    };
+
+    /* the shared state of a task and its tid; it's reference counted
+     * intrusively and the completion is published with an atomic flag,
+     * so the lock and condvar are only ever touched when somebody has
+     * to actually wait for the result
+     *
+     * a single continuation may be attached, which is run by whoever
+     * finishes the task (or right away, if it's already finished)
+     */
+    struct OSTD_EXPORT tid_base {
+        tid_base() = delete;
+        tid_base(tid_base const &) = delete;
+        tid_base &operator=(tid_base const &) = delete;
 
         template<typename F>
-        tid_impl(F &func): p_lock(), p_eptr(), p_cond(func()) {}
+        tid_base(F &func, scheduler *s): p_lock(), p_cond(func()), p_sched(s) {}
 
-        T get() {
+        /* empty, for vtable placement */
+        virtual ~tid_base();
+
+        void wait() {
+            if (p_done.load(std::memory_order_acquire)) {
+                return;
+            }
             std::unique_lock<std::mutex> l{p_lock};
-            while (!p_stor) {
+            p_waiting.store(true);
+            while (!p_done.load()) {
                 p_cond.wait(l);
             }
+        }
+
+        void retain() noexcept {
+            p_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release() noexcept {
+            if (p_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        void set_cont(tid_cont *c) {
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                /* makes the finisher take the lock and see the slot */
+                p_waiting.store(true);
+                if (!p_done.load()) {
+                    p_cont = c;
+                    return;
+                }
+            }
+            c->ready();
+        }
+
+        /* the scheduler the task was spawned on, may be null */
+        scheduler *get_scheduler() const noexcept {
+            return p_sched;
+        }
+
+    protected:
+        void finish() noexcept {
+            p_done.store(true);
+            if (p_waiting.load()) {
+                tid_cont *c;
+                {
+                    /* make sure the waiter is not between its check and wait */
+                    std::lock_guard<std::mutex> l{p_lock};
+                    c = std::exchange(p_cont, nullptr);
+                }
+                p_cond.notify_all();
+                if (c) {
+                    c->ready();
+                }
+            }
+        }
+
+        std::exception_ptr p_eptr;
+
+    private:
+        std::mutex p_lock;
+        generic_condvar p_cond;
+        scheduler *p_sched;
+        tid_cont *p_cont = nullptr;
+        std::atomic<std::size_t> p_refs{1};
+        std::atomic<bool> p_done{false};
+        std::atomic<bool> p_waiting{false};
+    };
+
+    template<typename T>
+    struct tid_impl: tid_base {
+        template<typename F>
+        tid_impl(F &func, scheduler *s): tid_base(func, s) {}
+
+        T get() {
+            wait();
             if (p_eptr) {
                 std::rethrow_exception(std::exchange(p_eptr, nullptr));
             }
-            auto ret = std::move(p_stor);
             if constexpr(!std::is_same_v<T, void>) {
                 if constexpr(std::is_lvalue_reference_v<T>) {
-                    return **ret;
+                    return **p_stor;
                 } else {
-                    return std::move(*ret);
+                    return std::move(*p_stor);
                 }
             }
         }
 
-        void wait() {
-            std::unique_lock<std::mutex> l{p_lock};
-            while (!p_stor) {
-                p_cond.wait(l);
-            }
-        }
-
+    protected:
+        /* the function runs unlocked, as it may block or yield the task,
+         * which may then be resumed on another thread; nobody looks at
+         * the result until the flag is set, so no lock is needed either
+         */
         template<typename F>
         void set_value(F &func) {
-            {
-                std::lock_guard<std::mutex> l{p_lock};
-                try {
-                    if constexpr(std::is_same_v<T, void>) {
-                        func();
-                        p_stor = true;
+            try {
+                if constexpr(std::is_same_v<T, void>) {
+                    func();
+                    p_stor = true;
+                } else {
+                    if constexpr(std::is_lvalue_reference_v<T>) {
+                        p_stor = &func();
                     } else {
-                        if constexpr(std::is_lvalue_reference_v<T>) {
-                            p_stor = &func();
-                        } else {
-                            p_stor = std::move(func());
-                        }
+                        p_stor = std::move(func());
                     }
-                } catch (...) {
-                    p_eptr = std::current_exception();
                 }
+            } catch (...) {
+                p_eptr = std::current_exception();
             }
-            p_cond.notify_one();
+            finish();
         }
 
     private:
@@ -129,11 +247,50 @@ namespace detail {
             >>
         >;
 
-        mutable std::mutex p_lock;
-        mutable std::exception_ptr p_eptr;
-        generic_condvar p_cond;
         storage p_stor = storage{};
     };
+
+    /* the callable lives in the same allocation as the shared state and
+     * is destroyed as soon as it's done, the result may live on for longer
+     */
+    template<typename T, typename F>
+    struct tid_task: tid_impl<T> {
+        template<typename CF, typename FF>
+        tid_task(CF &cfunc, FF &&func, scheduler *s):
+            tid_impl<T>(cfunc, s), p_func(std::forward<FF>(func))
+        {}
+
+        void run() {
+            this->set_value(*p_func);
+            p_func.reset();
+        }
+
+        /* finishes the task without running it */
+        void fail(std::exception_ptr e) {
+            auto func = [&e]() -> T {
+                std::rethrow_exception(e);
+            };
+            this->set_value(func);
+            p_func.reset();
+        }
+
+    private:
+        std::optional<F> p_func;
+    };
+
+    /* a state with no task behind it, finished by whoever holds it */
+    template<typename T>
+    struct tid_promise: tid_impl<T> {
+        template<typename CF>
+        tid_promise(CF &cfunc, scheduler *s): tid_impl<T>(cfunc, s) {}
+
+        template<typename F>
+        void complete(F &func) {
+            this->set_value(func);
+        }
+    };
+
+    struct tid_access;
 }
 
 /** @brief An object that defines a task.
@@ -156,13 +313,25 @@ namespace detail {
 template<typename T>
 struct tid {
     friend struct scheduler;
+    friend struct detail::tid_access;
 
     tid() = delete;
     tid(tid const &) = delete;
     tid &operator=(tid const &) = delete;
 
-    tid(tid &&) = default;
-    tid &operator=(tid &&) = default;
+    tid(tid &&t) noexcept: p_state(std::exchange(t.p_state, nullptr)) {}
+
+    tid &operator=(tid &&t) noexcept {
+        std::swap(p_state, t.p_state);
+        return *this;
+    }
+
+    /** @brief Drops the reference to the shared state, if any. */
+    ~tid() {
+        if (p_state) {
+            p_state->release();
+        }
+    }
 
     /** @brief Waits for the result and returns it.
      *
@@ -175,13 +344,13 @@ struct tid {
      * call this when valid() is not true.
      */
     T get() {
-        auto p = std::move(p_state);
-        return p->get();
+        tid t{std::move(*this)};
+        return t.p_state->get();
     }
 
     /** @brief Checks if this `tid` points to a valid shared state. */
     bool valid() const {
-        return p_state;
+        return p_state != nullptr;
     }
 
     /** @brief Waits for the associated task to finish.
@@ -192,11 +361,33 @@ struct tid {
         p_state->wait();
     }
 
-private:
+    /** @brief Attaches a continuation to the task.
+     *
+     * Once the task is finished, `func` is spawned as a new task on the
+     * same scheduler, getting this `tid` (now finished) as its argument,
+     * so it can get() the result or handle the exception. Nothing waits
+     * for the task in the meantime, neither a task nor a thread. If the
+     * task is already finished, the continuation is spawned right away.
+     * A task spawned outside of any scheduler runs the continuation
+     * directly on the thread that finishes it.
+     *
+     * The continuation is spawned by whoever finishes the task; if that
+     * fails, the exception is stored in the returned `tid` instead.
+     *
+     * After this call is done, valid() will no longer be true. It is
+     * undefined to call this when valid() is not true.
+     *
+     * @returns A `tid` for the continuation.
+     *
+     * @see ostd::when_all(), ostd::when_any()
+     */
     template<typename F>
-    tid(F func): p_state(new detail::tid_impl<T>{func}) {}
+    tid<std::result_of_t<F(tid<T>)>> then(F func);
 
-    std::shared_ptr<detail::tid_impl<T>> p_state;
+private:
+    tid(detail::tid_impl<T> *st) noexcept: p_state(st) {}
+
+    detail::tid_impl<T> *p_state;
 };
 
 /** @brief A base interface for any scheduler.
@@ -222,7 +413,7 @@ private:
             return p_sched->allocate_stack();
         }
 
-        void deaallocate(stack_context &st) noexcept {
+        void deallocate(stack_context &st) noexcept {
             p_sched->deallocate_stack(st);
         }
 
@@ -263,6 +454,20 @@ public:
      */
     virtual void yield() noexcept = 0;
 
+    /** @brief Suspends the current task until the given time point.
+     *
+     * This is a low level interface function. Typically you will want
+     * sleep_for(), sleep_until() or their global counterparts. Coroutine
+     * based schedulers suspend only the task and keep running other tasks
+     * on the thread in the meantime; ostd::thread_scheduler simply puts
+     * the thread to sleep.
+     *
+     * @see sleep_for(), sleep_until(), ostd::sleep_for()
+     */
+    virtual void do_sleep_until(
+        std::chrono::steady_clock::time_point const &tp
+    ) = 0;
+
     /** @brief Creates a condition variable using ostd::generic_condvar.
      *
      * A scheduler might be using a custom condition variable type depending
@@ -304,6 +509,17 @@ public:
      */
     virtual void reserve_stacks(std::size_t n) = 0;
 
+    /** @brief Gives the memory of unused stacks back to the system.
+     *
+     * If the stack allocator used in the scheduler is pooled, this keeps
+     * at most `keep` of the unused stacks ready and releases the memory
+     * of the others, see ostd::basic_stack_pool::trim(). By default, and
+     * if the allocator is not pooled, this does nothing.
+     *
+     * @see reserve_stacks()
+     */
+    virtual void trim_stacks(std::size_t = 0) noexcept {}
+
     /** @brief Gets a stack allocator using the scheduler's stack allocation.
      *
      * The stack allocator will use allocate_stack() and deallocate_stack()
@@ -327,25 +543,68 @@ public:
      */
     template<typename F, typename ...A>
     tid<std::result_of_t<F(A...)>> spawn(F func, A &&...args) {
-        tid<std::result_of_t<F(A...)>> t{[this]() {
+        using R = std::result_of_t<F(A...)>;
+        auto mkcond = [this]() {
             return make_condition();
-        }};
-        /* private shared state reference */
-        auto st = t.p_state;
+        };
         if constexpr(sizeof...(A) == 0) {
-            do_spawn([lfunc = std::move(func), lst = std::move(st)]() {
-                lst->set_value(lfunc);
-            });
+            return spawn_state<R>(
+                new detail::tid_task<R, F>{mkcond, std::move(func), this}
+            );
         } else {
-            do_spawn([lfunc = std::bind(
-                std::move(func), std::forward<A>(args)...
-            ), lst = std::move(st)]() {
-                lst->set_value(lfunc);
+            auto bfunc = std::bind(std::move(func), std::forward<A>(args)...);
+            return spawn_state<R>(
+                new detail::tid_task<R, decltype(bfunc)>{
+                    mkcond, std::move(bfunc), this
+                }
+            );
+        }
+    }
+
+private:
+    /* the shared state and the callable are a single allocation, and
+     * the function passed to do_spawn() only holds a pointer to them, so
+     * it fits in the small buffer of std::function; the task holds its
+     * own reference, which is dropped as soon as it's finished
+     */
+    template<typename R, typename S>
+    tid<R> spawn_state(S *st) {
+        tid<R> t{st};
+        st->retain();
+        try {
+            do_spawn([st]() {
+                st->run();
+                st->release();
             });
+        } catch (...) {
+            st->release();
+            throw;
         }
         return t;
     }
 
+public:
+    /** @brief Suspends the current task until the given time point.
+     *
+     * Time points of clocks other than `std::chrono::steady_clock` are
+     * converted to it first. Then calls do_sleep_until().
+     *
+     * @see sleep_for(), ostd::sleep_until()
+     */
+    template<typename C, typename D>
+    void sleep_until(std::chrono::time_point<C, D> const &tp) {
+        do_sleep_until(detail::steady_deadline(tp));
+    }
+
+    /** @brief Suspends the current task for at least the given duration.
+     *
+     * @see sleep_until(), ostd::sleep_for()
+     */
+    template<typename R, typename P>
+    void sleep_for(std::chrono::duration<R, P> const &dur) {
+        do_sleep_until(detail::steady_deadline(dur));
+    }
+
     /** @brief Creates a channel suitable for the scheduler.
      *
      * Returns a channel that uses a condition variable type returned by
@@ -364,6 +623,22 @@ public:
         }};
     }
 
+    /** @brief Creates a bounded channel suitable for the scheduler.
+     *
+     * Like make_channel(), but creates an ostd::bounded_channel with
+     * the given capacity.
+     *
+     * @tparam T The type of the channel value.
+     *
+     * @see ostd::make_bounded_channel()
+     */
+    template<typename T>
+    bounded_channel<T> make_bounded_channel(std::size_t cap) {
+        return bounded_channel<T>{cap, [this]() {
+            return make_condition();
+        }};
+    }
+
     /** @brief Creates a coroutine using the scheduler's stack allocator.
      *
      * Using ostd::make_coroutine() will do the same thing, but without
@@ -477,6 +752,10 @@ struct basic_thread_scheduler: scheduler {
         std::this_thread::yield();
     }
 
+    void do_sleep_until(std::chrono::steady_clock::time_point const &tp) {
+        std::this_thread::sleep_until(tp);
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{};
     }
@@ -495,7 +774,7 @@ struct basic_thread_scheduler: scheduler {
             std::lock_guard<std::mutex> l{p_lock};
             p_stacks.deallocate(st);
         } else {
-            p_stacks.deallocate();
+            p_stacks.deallocate(st);
         }
     }
 
@@ -508,6 +787,15 @@ struct basic_thread_scheduler: scheduler {
         }
     }
 
+    void trim_stacks(std::size_t keep = 0) noexcept {
+        if constexpr(!SA::is_thread_safe) {
+            std::lock_guard<std::mutex> l{p_lock};
+            p_stacks.trim(keep);
+        } else {
+            p_stacks.trim(keep);
+        }
+    }
+
 private:
     void remove_thread(typename std::list<std::thread>::iterator it) {
         std::lock_guard<std::mutex> l{p_lock};
@@ -516,34 +804,64 @@ private:
             t.join();
         }
         p_threads.erase(it);
+        if (p_threads.empty()) {
+            p_cond.notify_all();
+        }
     }
 
     void join_all() {
-        /* wait for all threads to finish */
-        std::lock_guard<std::mutex> l{p_lock};
+        /* wait for all threads to finish; they remove themselves and the
+         * last one to do so is joined here, so the lock must not be held
+         * while waiting
+         */
+        std::unique_lock<std::mutex> l{p_lock};
+        while (!p_threads.empty()) {
+            p_cond.wait(l);
+        }
         if (p_dead.joinable()) {
             p_dead.join();
         }
-        for (auto &t: p_threads) {
-            t.join();
-            p_threads.pop_front();
-        }
     }
 
     SA p_stacks;
     std::list<std::thread> p_threads;
     std::thread p_dead;
+    std::condition_variable p_cond;
     std::mutex p_lock;
 };
 
-/** @brief An ostd::basic_thread_scheduler using ostd::stack_pool. */
-using thread_scheduler = basic_thread_scheduler<stack_pool>;
+/** @brief An ostd::basic_thread_scheduler using ostd::concurrent_stack_pool. */
+using thread_scheduler = basic_thread_scheduler<concurrent_stack_pool>;
 
 namespace detail {
     struct csched_task;
 
     OSTD_EXPORT extern thread_local csched_task *current_csched_task;
 
+    /* makes a task run on a shared stack instead of one of its own; it
+     * may be null, then the stack is bound right before the first run
+     */
+    struct shared_stack_arg {
+        shared_stack *stack;
+    };
+
+    /* the shared stack of a scheduler thread; it has a guard page, since
+     * overflowing it would corrupt every task using it at once
+     */
+    template<typename TR>
+    struct sched_shared_stack {
+        sched_shared_stack(std::size_t sz):
+            p_alloc{sz}, p_ctx{p_alloc.allocate()}
+        {}
+
+        ~sched_shared_stack() {
+            p_alloc.deallocate(p_ctx.p_stack);
+        }
+
+        basic_fixedsize_stack<TR, true> p_alloc;
+        shared_stack p_ctx;
+    };
+
     struct OSTD_EXPORT csched_task: coroutine_context {
         friend struct coroutine_context;
 
@@ -562,13 +880,20 @@ namespace detail {
                 this->set_dead();
                 return;
             }
-            this->make_context<csched_task>(sa);
+            if constexpr(std::is_same_v<std::decay_t<SA>, shared_stack_arg>) {
+                this->make_shared_context<csched_task>(sa.stack);
+            } else {
+                this->make_context<csched_task>(sa);
+            }
         }
 
         void operator()() {
             this->set_exec();
             csched_task *curr = std::exchange(current_csched_task, this);
+            /* the cancellation state is task local */
+            cancel_state *cs = swap_current_cancel(p_cancel);
             this->coro_jump();
+            p_cancel = swap_current_cancel(cs);
             current_csched_task = curr;
             this->rethrow();
         }
@@ -585,6 +910,9 @@ namespace detail {
             return this->is_dead();
         }
 
+        using coroutine_context::needs_stack;
+        using coroutine_context::bind_stack;
+
         static csched_task *current() noexcept {
             return current_csched_task;
         }
@@ -595,6 +923,7 @@ namespace detail {
         }
 
         std::function<void()> p_func;
+        cancel_state *p_cancel = nullptr;
     };
 }
 
@@ -624,28 +953,90 @@ private:
 
         coro_cond(basic_simple_coroutine_scheduler &s): p_sched(s) {}
 
+        /* notify_one hands out a single wakeup, notify_all starts
+         * a new generation which releases everybody waiting so far;
+         * the counters are atomic so that other threads (such as an
+         * ostd::reactor) can notify too
+         */
         template<typename L>
         void wait(L &l) noexcept {
+            std::size_t gen = p_gen.load();
+            ++p_waiters;
+            l.unlock();
+            while (!woken(gen)) {
+                p_sched.yield();
+            }
+            --p_waiters;
+            l.lock();
+        }
+
+        /* woken up tasks are only ever found by polling, so the timed
+         * wait polls the clock along with the generation and signals
+         */
+        template<typename L>
+        std::cv_status wait_until(
+            L &l, std::chrono::steady_clock::time_point const &tp
+        ) noexcept {
+            std::size_t gen = p_gen.load();
+            auto ret = std::cv_status::no_timeout;
+            ++p_waiters;
             l.unlock();
-            while (!p_notified) {
+            while (!woken(gen)) {
+                if (std::chrono::steady_clock::now() >= tp) {
+                    ret = std::cv_status::timeout;
+                    break;
+                }
                 p_sched.yield();
             }
-            p_notified = false;
+            --p_waiters;
             l.lock();
+            return ret;
         }
 
+        /* only yield to the woken up task when there is one, so that
+         * notifying nobody in a loop doesn't switch tasks every time
+         */
         void notify_one() noexcept {
-            p_notified = true;
-            p_sched.yield();
+            std::size_t sigs = p_signals.load();
+            while (sigs < p_waiters.load()) {
+                if (p_signals.compare_exchange_weak(sigs, sigs + 1)) {
+                    yield();
+                    return;
+                }
+            }
         }
 
         void notify_all() noexcept {
-            p_notified = true;
-            p_sched.yield();
+            ++p_gen;
+            p_signals.store(0);
+            if (p_waiters.load()) {
+                yield();
+            }
         }
     private:
+        bool woken(std::size_t gen) noexcept {
+            if (gen != p_gen.load()) {
+                return true;
+            }
+            std::size_t sigs = p_signals.load();
+            while (sigs) {
+                if (p_signals.compare_exchange_weak(sigs, sigs - 1)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void yield() noexcept {
+            if (detail::csched_task::current()) {
+                p_sched.yield();
+            }
+        }
+
         basic_simple_coroutine_scheduler &p_sched;
-        bool p_notified = false;
+        std::atomic<std::size_t> p_gen{0};
+        std::atomic<std::size_t> p_waiters{0};
+        std::atomic<std::size_t> p_signals{0};
     };
 
 public:
@@ -657,6 +1048,37 @@ public:
         p_stacks(std::move(sa))
     {}
 
+    /** @brief Makes the tasks share a single stack.
+     *
+     * Instead of taking a stack from the allocator each, the spawned tasks
+     * run one after another on a stack of the given size. When switching
+     * to a task, the used part of the stack of the one that ran before it
+     * is copied out to a buffer fitting it and the new one's is copied
+     * back in, unless it's the same task. That trades a copy for memory
+     * on every switch, which pays off with a lot of mostly idle tasks with
+     * shallow stacks, such as connection handlers.
+     *
+     * The main task still gets a stack of its own. The size should be as
+     * much stack as any task may need, e.g. `SA::traits_type::default_size()`
+     * for the same limit the allocated stacks have. The memory is only
+     * taken up as far as the tasks actually use it. A size of zero turns
+     * it off, which is the default.
+     *
+     * Since a task's stack is only in place while it's running, objects
+     * on it must not be used by other tasks while it's suspended. That
+     * means a task must not give out references to its locals, say by
+     * capturing them by reference in the tasks it spawns.
+     *
+     * Must be called before start().
+     */
+    void set_shared_stack(std::size_t size) {
+        if (!size) {
+            p_shared.reset();
+        } else {
+            p_shared = std::make_unique<shared_stack>(size);
+        }
+    }
+
     /** @brief Starts the scheduler given a set of arguments.
      *
      * Sets the internal current scheduler pointer to this scheduler creates
@@ -677,6 +1099,7 @@ public:
 
         using R = std::result_of_t<F(A...)>;
 
+        p_stats.spawned();
         if constexpr(std::is_same_v<R, void>) {
             if constexpr(sizeof...(A) == 0) {
                 p_coros.emplace_back(std::move(func), std::forward<TSA>(sa));
@@ -724,7 +1147,16 @@ public:
     }
 
     void do_spawn(std::function<void()> func) {
-        p_coros.emplace_back(std::move(func), p_stacks.get_allocator());
+        if (p_shared) {
+            p_coros.emplace_back(
+                std::move(func), detail::shared_stack_arg{&p_shared->p_ctx}
+            );
+        } else {
+            p_coros.emplace_back(
+                std::move(func), p_stats.stacks(p_stacks.get_allocator())
+            );
+        }
+        p_stats.spawned();
         yield();
     }
 
@@ -732,6 +1164,17 @@ public:
         detail::csched_task::current()->yield();
     }
 
+    void do_sleep_until(std::chrono::steady_clock::time_point const &tp) {
+        if (!detail::csched_task::current()) {
+            std::this_thread::sleep_until(tp);
+            return;
+        }
+        /* the dispatcher takes the task out of the rotation */
+        p_wakeup = tp;
+        p_sleep = true;
+        yield();
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{[this]() {
             return coro_cond{*this};
@@ -739,10 +1182,13 @@ public:
     }
 
     stack_context allocate_stack() {
-        return p_stacks.allocate();
+        auto ret = p_stacks.allocate();
+        p_stats.stack_taken(1);
+        return ret;
     }
 
     void deallocate_stack(stack_context &st) noexcept {
+        p_stats.stack_taken(-1);
         p_stacks.deallocate(st);
     }
 
@@ -750,24 +1196,87 @@ public:
         p_stacks.reserve(n);
     }
 
+    void trim_stacks(std::size_t keep = 0) noexcept {
+        p_stacks.trim(keep);
+    }
+
+    /** @brief Gets a snapshot of the statistics of the scheduler.
+     *
+     * See ostd::sched_stats. Only the number of queued tasks is available
+     * unless `OSTD_USE_SCHED_STATS` is defined. There is no lock to wait
+     * for and nothing to steal. The task stacks include the ones given out
+     * by allocate_stack().
+     *
+     * As the scheduler is not thread safe, this must only be called from
+     * its own thread, typically from within a task.
+     */
+    sched_stats stats() const noexcept {
+        sched_stats ret;
+        ret.queued = p_coros.size();
+        if (ret.queued && detail::csched_task::current()) {
+            --ret.queued;
+        }
+        p_stats.get(ret);
+        return ret;
+    }
+
 private:
+    /* sleeping tasks are spliced into a separate list, so they're not
+     * resumed at all until their time comes; the timers are checked once
+     * per round and the thread only sleeps when every task is sleeping
+     */
     void dispatch() {
-        while (!p_coros.empty()) {
+        while (!p_coros.empty() || !p_timers.empty()) {
+            if (p_coros.empty()) {
+                std::this_thread::sleep_until(p_timers.begin()->first);
+                wake_sleepers();
+                continue;
+            }
             if (p_idx == p_coros.end()) {
+                wake_sleepers();
                 p_idx = p_coros.begin();
             }
+            p_stats.switched();
+            auto start = p_stats.now();
             (*p_idx)();
+            p_stats.ran(start);
             if (p_idx->dead()) {
+                p_stats.completed();
                 p_idx = p_coros.erase(p_idx);
+            } else if (p_sleep) {
+                p_sleep = false;
+                auto it = p_idx++;
+                p_timers.emplace(p_wakeup, it);
+                p_sleeping.splice(p_sleeping.end(), p_coros, it);
             } else {
                 ++p_idx;
             }
         }
     }
 
+    void wake_sleepers() {
+        auto now = std::chrono::steady_clock::now();
+        while (!p_timers.empty() && (p_timers.begin()->first <= now)) {
+            p_coros.splice(p_coros.end(), p_sleeping, p_timers.begin()->second);
+            p_timers.erase(p_timers.begin());
+        }
+    }
+
+    using task_list = std::list<detail::csched_task>;
+    using shared_stack = detail::sched_shared_stack<typename SA::traits_type>;
+
     SA p_stacks;
-    std::list<detail::csched_task> p_coros;
-    typename std::list<detail::csched_task>::iterator p_idx = p_coros.end();
+    detail::sched_counters p_stats;
+    /* outlives the tasks, which may still have to unwind on it */
+    std::unique_ptr<shared_stack> p_shared;
+    task_list p_coros;
+    task_list p_sleeping;
+    typename task_list::iterator p_idx = p_coros.end();
+    std::multimap<
+        std::chrono::steady_clock::time_point, typename task_list::iterator
+    > p_timers;
+    std::chrono::steady_clock::time_point p_wakeup;
+    bool p_sleep = false;
 };
 
 /** @brief An ostd::basic_simple_coroutine_scheduler using ostd::stack_pool. */
@@ -781,6 +1290,15 @@ using simple_coroutine_scheduler = basic_simple_coroutine_scheduler<stack_pool>;
  * so they're completely hidden from the outside code. This also has several
  * advantages for code using coroutines.
  *
+ * Every thread has its own queue of runnable tasks. Tasks spawned, yielded
+ * or woken up from within a task go to the queue of the thread running it,
+ * and threads that run out of tasks steal them from the queues of others
+ * before going to sleep. Sleeping threads are only woken up when there is
+ * work for them, so there is no single lock every context switch has to
+ * go through.
+ *
+ * The threads can be pinned to CPUs and named, see set_affinity().
+ *
  * @tparam SA The stack allocator to use when requesting stacks. Used for
  *            the tasks as well as for the stack request methods.
  */
@@ -791,10 +1309,20 @@ struct basic_coroutine_scheduler: scheduler {
 
 private:
     struct task_cond;
+    struct worker;
     struct task;
 
-    using tlist = std::list<task>;
-    using titer = typename tlist::iterator;
+    using timer_map = std::multimap<
+        std::chrono::steady_clock::time_point, task *
+    >;
+
+    /* a task suspended in a timed wait can be woken up either by the
+     * condvar or by its timer; whichever gets to change the state from
+     * WAITING first is the one to reschedule it
+     */
+    enum class wake_state {
+        WAITING, WOKEN, TIMED_OUT
+    };
 
     struct task {
     private:
@@ -803,7 +1331,14 @@ private:
     public:
         task_cond *waiting_on = nullptr;
         task *next_waiting = nullptr;
-        titer pos;
+        worker *p_worker = nullptr;
+        worker *p_home = nullptr;
+        worker *p_pin = nullptr;
+        std::chrono::steady_clock::time_point p_deadline{};
+        typename timer_map::iterator p_timer{};
+        std::atomic<wake_state> p_wstate{wake_state::WOKEN};
+        bool p_timed = false;
+        bool p_intimer = false;
 
         template<typename F, typename TSA>
         task(F &&f, TSA &&sa):
@@ -822,47 +1357,201 @@ private:
             return p_func.dead();
         }
 
+        /* a task on a shared stack can only ever run on the thread owning
+         * the stack, so it's bound to the one it first runs on
+         */
+        void pin(worker &w) noexcept {
+            if (p_func.needs_stack()) {
+                p_func.bind_stack(w.p_shared->p_ctx);
+                p_pin = &w;
+            }
+        }
+
         static task *current() noexcept {
             return reinterpret_cast<task *>(detail::csched_task::current());
         }
     };
 
-    struct task_cond {
-        friend struct basic_coroutine_scheduler;
+    using shared_stack = detail::sched_shared_stack<typename SA::traits_type>;
 
-        task_cond() = delete;
-        task_cond(task_cond const &) = delete;
-        task_cond(task_cond &&) = delete;
-        task_cond &operator=(task_cond const &) = delete;
-        task_cond &operator=(task_cond &&) = delete;
+    struct worker {
+        std::mutex p_lock;
+        std::deque<task *> p_queue;
+        std::uint32_t p_seed;
+        detail::sched_counters p_stats;
+        std::unique_ptr<shared_stack> p_shared;
+        /* the queued tasks pinned to this thread */
+        std::atomic<std::size_t> p_npinned{0};
 
-        task_cond(basic_coroutine_scheduler &s): p_sched(s) {}
+        worker(std::uint32_t seed): p_seed{seed | 1} {}
 
-        template<typename L>
-        void wait(L &l) noexcept {
-            /* lock until the task has been added to the wait queue,
-             * that ensures that any notify/notify_any has to wait
-             * until after the task has fully blocked... we can't
-             * use unique_lock or lock_guard because they're scoped
-             */
-            p_sched.p_lock.lock();
-            l.unlock();
-            task *curr = task::current();
-            curr->waiting_on = this;
-            curr->yield();
-            l.lock();
+        ~worker() {
+            while (void *b = take_block()) {
+                ::operator delete(b);
+            }
+        }
+
+        /* the memory of dead tasks is kept around for new tasks spawned
+         * by the same thread; only that thread touches the local list,
+         * tasks that die elsewhere are given back through the remote one
+         */
+        void *take_block() noexcept {
+            if (!p_blocks && p_remote.load(std::memory_order_relaxed)) {
+                p_blocks = p_remote.exchange(
+                    nullptr, std::memory_order_acquire
+                );
+                p_nblocks += p_nremote.exchange(0, std::memory_order_relaxed);
+            }
+            void *b = p_blocks;
+            if (b) {
+                p_blocks = *static_cast<void **>(b);
+                p_nblocks -= !!p_nblocks;
+            }
+            return b;
+        }
+
+        void put_block(void *b) noexcept {
+            if (p_nblocks >= MAX_BLOCKS) {
+                ::operator delete(b);
+                return;
+            }
+            *static_cast<void **>(b) = p_blocks;
+            p_blocks = b;
+            ++p_nblocks;
+        }
+
+        void put_remote(void *b) noexcept {
+            if (p_nremote.load(std::memory_order_relaxed) >= MAX_BLOCKS) {
+                ::operator delete(b);
+                return;
+            }
+            p_nremote.fetch_add(1, std::memory_order_relaxed);
+            void *head = p_remote.load(std::memory_order_relaxed);
+            do {
+                *static_cast<void **>(b) = head;
+            } while (!p_remote.compare_exchange_weak(
+                head, b, std::memory_order_release, std::memory_order_relaxed
+            ));
+        }
+
+        /* xorshift, only used to pick steal victims */
+        std::size_t next_victim(std::size_t n) noexcept {
+            p_seed ^= p_seed << 13;
+            p_seed ^= p_seed >> 17;
+            p_seed ^= p_seed << 5;
+            return p_seed % n;
+        }
+
+    private:
+        static constexpr std::size_t MAX_BLOCKS = 128;
+
+        void *p_blocks = nullptr;
+        std::size_t p_nblocks = 0;
+        std::atomic<void *> p_remote{nullptr};
+        std::atomic<std::size_t> p_nremote{0};
+    };
+
+    struct task_cond {
+        friend struct basic_coroutine_scheduler;
+
+        task_cond() = delete;
+        task_cond(task_cond const &) = delete;
+        task_cond(task_cond &&) = delete;
+        task_cond &operator=(task_cond const &) = delete;
+        task_cond &operator=(task_cond &&) = delete;
+
+        task_cond(basic_coroutine_scheduler &s): p_sched(s) {}
+
+        template<typename L>
+        void wait(L &l) noexcept {
+            suspend(l, nullptr);
+        }
+
+        template<typename L>
+        std::cv_status wait_until(
+            L &l, std::chrono::steady_clock::time_point const &tp
+        ) noexcept {
+            if (std::chrono::steady_clock::now() >= tp) {
+                return std::cv_status::timeout;
+            }
+            return suspend(l, &tp);
         }
 
         void notify_one() noexcept {
-            p_sched.notify_one(p_waiting);
+            p_sched.notify_one(*this);
         }
 
         void notify_all() noexcept {
-            p_sched.notify_all(p_waiting);
+            p_sched.notify_all(*this);
         }
     private:
+        template<typename L>
+        std::cv_status suspend(
+            L &l, std::chrono::steady_clock::time_point const *tp
+        ) noexcept {
+            /* lock until the task has been added to the wait queue,
+             * that ensures that any notify/notify_any has to wait
+             * until after the task has fully blocked... we can't
+             * use unique_lock or lock_guard because they're scoped
+             */
+            lock();
+            l.unlock();
+            task *curr = task::current();
+            curr->waiting_on = this;
+            curr->p_wstate.store(wake_state::WAITING);
+            if (tp) {
+                curr->p_deadline = *tp;
+                curr->p_timed = true;
+            }
+            curr->yield();
+            curr->p_timed = false;
+            l.lock();
+            if (curr->p_wstate.load() == wake_state::TIMED_OUT) {
+                return std::cv_status::timeout;
+            }
+            return std::cv_status::no_timeout;
+        }
+
+        /* takes out a task whose timer went off first */
+        void unlink(task *t) noexcept {
+            task *prev = nullptr;
+            for (task *it = p_waiting; it; prev = it, it = it->next_waiting) {
+                if (it != t) {
+                    continue;
+                }
+                if (prev) {
+                    prev->next_waiting = t->next_waiting;
+                } else {
+                    p_waiting = t->next_waiting;
+                }
+                if (p_wlast == t) {
+                    p_wlast = prev;
+                }
+                t->next_waiting = nullptr;
+                return;
+            }
+        }
+
+        /* a spinlock keeps the condvar small enough for generic_condvar;
+         * it's only ever held for a few instructions and for the switch
+         * out of a waiting task
+         */
+        void lock() noexcept {
+            while (p_wlock.exchange(true, std::memory_order_acquire)) {
+                while (p_wlock.load(std::memory_order_relaxed)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void unlock() noexcept {
+            p_wlock.store(false, std::memory_order_release);
+        }
+
         basic_coroutine_scheduler &p_sched;
         task *p_waiting = nullptr;
+        task *p_wlast = nullptr;
+        std::atomic<bool> p_wlock{false};
     };
 
 public:
@@ -876,11 +1565,53 @@ public:
     basic_coroutine_scheduler(
         std::size_t thrs = std::thread::hardware_concurrency(), SA &&sa = SA{}
     ):
-        p_threads(thrs), p_stacks(std::move(sa))
+        p_threads(std::max(thrs, std::size_t(1))), p_stacks(std::move(sa))
     {}
 
     ~basic_coroutine_scheduler() {}
 
+    /** @brief Sets how the threads of the scheduler are placed and named.
+     *
+     * Must be called before start(). The `i`-th thread is placed according
+     * to ostd::thread_cpus().
+     *
+     * @throws std::system_error if any of the CPUs is not available.
+     */
+    void set_affinity(thread_affinity const &aff) {
+        p_placer = detail::thread_placer{aff};
+    }
+
+    /** @brief Makes the tasks share a stack per thread.
+     *
+     * Instead of taking a stack from the allocator each, the spawned tasks
+     * run on a stack of the given size belonging to the thread running
+     * them. When switching to a task, the used part of the stack of the
+     * one that ran before it is copied out to a buffer fitting it and the
+     * new one's is copied back in, unless it's the same task. That trades
+     * a copy for memory on every switch, which pays off with a lot of
+     * mostly idle tasks with shallow stacks, such as connection handlers.
+     *
+     * As the frames of a task have to stay at the same address, a task
+     * stays on the thread it first runs on. Tasks are only stolen by other
+     * threads before they start, so the load is balanced less evenly.
+     *
+     * The main task still gets a stack of its own. The size should be as
+     * much stack as any task may need, e.g. `SA::traits_type::default_size()`
+     * for the same limit the allocated stacks have. The memory is only
+     * taken up as far as the tasks actually use it. A size of zero turns
+     * it off, which is the default.
+     *
+     * Since a task's stack is only in place while it's running, objects
+     * on it must not be used by other tasks while it's suspended. That
+     * means a task must not give out references to its locals, say by
+     * capturing them by reference in the tasks it spawns.
+     *
+     * Must be called before start().
+     */
+    void set_shared_stack(std::size_t size) noexcept {
+        p_sstack = size;
+    }
+
     /** @brief Starts the scheduler given a set of arguments.
      *
      * Sets the internal current scheduler pointer to this scheduler creates
@@ -901,7 +1632,7 @@ public:
         detail::current_scheduler_owner iface{*this};
 
         /* start with one task in the queue, this way we can
-         * say we've finished when the task queue becomes empty
+         * say we've finished when there are no tasks left
          */
         using R = std::result_of_t<F(A...)>;
 
@@ -949,17 +1680,58 @@ public:
     }
 
     void do_spawn(std::function<void()> func) {
-        {
-            std::lock_guard<std::mutex> l{p_lock};
-            spawn_add(p_stacks.get_allocator(), std::move(func));
+        task *curr = task::current();
+        worker *home = curr ? curr->p_worker : nullptr;
+        void *mem = home ? home->take_block() : nullptr;
+        if (!mem) {
+            mem = ::operator new(sizeof(task));
         }
-        p_cond.notify_one();
+        auto &st = home ? home->p_stats : p_stats;
+        task *t;
+        try {
+            if (p_sstack) {
+                /* the stack is only picked once it runs */
+                t = ::new(mem) task{
+                    std::move(func), detail::shared_stack_arg{nullptr}
+                };
+            } else if constexpr(!SA::is_thread_safe) {
+                std::lock_guard<std::mutex> l{p_slock};
+                t = ::new(mem) task{
+                    std::move(func), st.stacks(p_stacks.get_allocator())
+                };
+            } else {
+                t = ::new(mem) task{
+                    std::move(func), st.stacks(p_stacks.get_allocator())
+                };
+            }
+        } catch (...) {
+            ::operator delete(mem);
+            throw;
+        }
+        st.spawned();
+        t->p_home = home;
+        p_ntasks.fetch_add(1);
+        schedule(t, false);
     }
 
     void yield() noexcept {
         task::current()->yield();
     }
 
+    void do_sleep_until(std::chrono::steady_clock::time_point const &tp) {
+        task *t = task::current();
+        if (!t) {
+            std::this_thread::sleep_until(tp);
+            return;
+        }
+        /* the timer is armed once the task has been switched out */
+        t->p_deadline = tp;
+        t->p_timed = true;
+        t->p_wstate.store(wake_state::WAITING);
+        t->yield();
+        t->p_timed = false;
+    }
+
     generic_condvar make_condition() {
         return generic_condvar{[this]() {
             return task_cond{*this};
@@ -967,155 +1739,495 @@ public:
     }
 
     stack_context allocate_stack() {
+        stack_context ret;
         if constexpr(!SA::is_thread_safe) {
-            std::lock_guard<std::mutex> l{p_lock};
-            return p_stacks.allocate();
+            std::lock_guard<std::mutex> l{p_slock};
+            ret = p_stacks.allocate();
         } else {
-            return p_stacks.allocate();
+            ret = p_stacks.allocate();
         }
+        p_stats.stack_taken(1);
+        return ret;
     }
 
     void deallocate_stack(stack_context &st) noexcept {
+        p_stats.stack_taken(-1);
         if constexpr(!SA::is_thread_safe) {
-            std::lock_guard<std::mutex> l{p_lock};
+            std::lock_guard<std::mutex> l{p_slock};
             p_stacks.deallocate(st);
         } else {
-            p_stacks.deallocate();
+            p_stacks.deallocate(st);
         }
     }
 
+    /** @brief Gets a snapshot of the statistics of the scheduler.
+     *
+     * See ostd::sched_stats. Only the number of queued tasks is available
+     * unless `OSTD_USE_SCHED_STATS` is defined. The task stacks include
+     * the ones given out by allocate_stack().
+     */
+    sched_stats stats() {
+        sched_stats ret;
+        ret.queued = p_pending.load();
+        std::lock_guard<std::mutex> l{p_lock};
+        p_stats.get(ret);
+        for (auto &w: p_workers) {
+            w->p_stats.get(ret);
+        }
+        return ret;
+    }
+
     void reserve_stacks(std::size_t n) {
         if constexpr(!SA::is_thread_safe) {
-            std::lock_guard<std::mutex> l{p_lock};
+            std::lock_guard<std::mutex> l{p_slock};
             p_stacks.reserve(n);
         } else {
             p_stacks.reserve(n);
         }
     }
 
+    void trim_stacks(std::size_t keep = 0) noexcept {
+        if constexpr(!SA::is_thread_safe) {
+            std::lock_guard<std::mutex> l{p_slock};
+            p_stacks.trim(keep);
+        } else {
+            p_stacks.trim(keep);
+        }
+    }
+
 private:
     template<typename TSA, typename F, typename ...A>
     void spawn_add(TSA &&sa, F &&func, A &&...args) {
         task *t = nullptr;
         if constexpr(sizeof...(A) == 0) {
-            t = &p_available.emplace_back(
-                std::forward<F>(func),
-                std::forward<TSA>(sa)
-            );
+            t = new task{std::forward<F>(func), std::forward<TSA>(sa)};
         } else {
-            t = &p_available.emplace_back(
+            t = new task{
                 [lfunc = std::bind(
                     std::forward<F>(func), std::forward<A>(args)...
                 )]() mutable {
                     lfunc();
                 },
                 std::forward<TSA>(sa)
-            );
+            };
         }
-        t->pos = --p_available.end();
+        p_ntasks.fetch_add(1);
+        p_pending.fetch_add(1);
+        p_inject.push_back(t);
+        p_ninject.fetch_add(1);
+        p_stats.spawned();
     }
 
     void init() {
         std::size_t size = p_threads;
+        {
+            /* the workers are looked at by stats() */
+            std::lock_guard<std::mutex> l{p_lock};
+            p_workers.clear();
+            for (std::size_t i = 0; i < size; ++i) {
+                auto &w = p_workers.emplace_back(
+                    std::make_unique<worker>(std::uint32_t(i * 2654435761U))
+                );
+                if (p_sstack) {
+                    w->p_shared = std::make_unique<shared_stack>(p_sstack);
+                }
+            }
+        }
         std::vector<std::thread> thrs;
         thrs.reserve(size);
         for (std::size_t i = 0; i < size; ++i) {
-            thrs.emplace_back([this]() { thread_run(); });
+            thrs.emplace_back([this, i, w = p_workers[i].get()]() {
+                p_placer.apply(i);
+                thread_run(*w);
+            });
         }
         for (std::size_t i = 0; i < size; ++i) {
             if (thrs[i].joinable()) {
                 thrs[i].join();
             }
         }
+        std::lock_guard<std::mutex> l{p_lock};
+        for (auto &w: p_workers) {
+            p_stats.merge(w->p_stats);
+        }
+        p_workers.clear();
     }
 
-    void notify_one(task *&wl) {
-        std::unique_lock<std::mutex> l{p_lock};
-        if (wl == nullptr) {
+    /* makes a task runnable; within a task it goes to the queue of the
+     * thread running it, at the front when it's been woken up, otherwise
+     * (when notified from the outside) to the shared queue
+     */
+    void schedule(task *t, bool front) {
+        task *curr = task::current();
+        schedule(t, front, curr ? curr->p_worker : nullptr);
+    }
+
+    void schedule(task *t, bool front, worker *w) {
+        /* a task pinned to another thread can't be stolen, so that very
+         * thread has to be woken up; there's no waking up a particular one
+         */
+        worker *self = w;
+        /* read before it's queued, it may be running right after */
+        worker *pin = t->p_pin;
+        p_pending.fetch_add(1);
+        if (pin) {
+            w = pin;
+            pinned(*w, 1);
+        }
+        if (w) {
+            std::lock_guard<std::mutex> l{w->p_lock};
+            if (front) {
+                w->p_queue.push_front(t);
+            } else {
+                w->p_queue.push_back(t);
+            }
+        } else {
+            auto l = p_stats.lock(p_lock);
+            p_inject.push_back(t);
+            p_ninject.fetch_add(1);
+        }
+        if (!pin) {
+            wake_one();
+        } else if (pin != self) {
+            wake_all();
+        }
+    }
+
+    /* a yielded task goes to the back of its thread's queue; nobody has
+     * to be woken up unless there is something else queued besides it
+     */
+    void reschedule(worker &w, task *t) {
+        bool others;
+        p_pending.fetch_add(1);
+        if (t->p_pin) {
+            pinned(w, 1);
+        }
+        {
+            std::lock_guard<std::mutex> l{w.p_lock};
+            others = !w.p_queue.empty();
+            w.p_queue.push_back(t);
+        }
+        if (others) {
+            wake_one();
+        }
+    }
+
+    void wake_one() {
+        if (!p_idle.load()) {
             return;
         }
-        wl->waiting_on = nullptr;
-        p_available.splice(p_available.cbegin(), p_waiting, wl->pos);
-        wl = std::exchange(wl->next_waiting, nullptr);
-        l.unlock();
+        {
+            /* make sure the sleeper is not between its check and wait */
+            std::lock_guard<std::mutex> l{p_lock};
+        }
         p_cond.notify_one();
-        task::current()->yield();
     }
 
-    void notify_all(task *&wl) {
+    void wake_all() {
+        if (!p_idle.load()) {
+            return;
+        }
         {
-            std::unique_lock<std::mutex> l{p_lock};
-            while (wl != nullptr) {
-                wl->waiting_on = nullptr;
-                p_available.splice(p_available.cbegin(), p_waiting, wl->pos);
-                wl = std::exchange(wl->next_waiting, nullptr);
-                l.unlock();
-                p_cond.notify_one();
-                l.lock();
+            std::lock_guard<std::mutex> l{p_lock};
+        }
+        p_cond.notify_all();
+    }
+
+    /* the counts are only ever off towards there being more to take */
+    void pinned(worker &w, std::ptrdiff_t n) noexcept {
+        w.p_npinned.fetch_add(std::size_t(n));
+        p_pinned.fetch_add(std::size_t(n));
+    }
+
+    /* whether the thread has anything to take; the tasks that are pinned
+     * to other threads don't count
+     */
+    bool runnable(worker &w) noexcept {
+        auto others = std::ptrdiff_t(p_pinned.load() - w.p_npinned.load());
+        return std::ptrdiff_t(p_pending.load()) > others;
+    }
+
+    /* takes the task over from the condvar, unless its timer got to it
+     * first, in which case the timer reschedules it instead
+     */
+    bool wake(task *t) {
+        auto st = wake_state::WAITING;
+        if (!t->p_wstate.compare_exchange_strong(st, wake_state::WOKEN)) {
+            return false;
+        }
+        t->waiting_on = nullptr;
+        if (t->p_timed) {
+            disarm_timer(t);
+        }
+        return true;
+    }
+
+    void notify_one(task_cond &c) {
+        for (;;) {
+            c.lock();
+            task *t = c.p_waiting;
+            if (!t) {
+                c.unlock();
+                return;
+            }
+            c.p_waiting = std::exchange(t->next_waiting, nullptr);
+            if (!c.p_waiting) {
+                c.p_wlast = nullptr;
+            }
+            c.unlock();
+            if (wake(t)) {
+                schedule(t, true);
+                return;
             }
         }
-        task::current()->yield();
     }
 
-    void thread_run() {
+    void notify_all(task_cond &c) {
+        c.lock();
+        task *t = std::exchange(c.p_waiting, nullptr);
+        c.p_wlast = nullptr;
+        c.unlock();
+        while (t) {
+            task *next = std::exchange(t->next_waiting, nullptr);
+            if (wake(t)) {
+                schedule(t, false);
+            }
+            t = next;
+        }
+    }
+
+    void update_next_timer() noexcept {
+        if (p_timers.empty()) {
+            p_tnext.store(NO_TIMER);
+        } else {
+            p_tnext.store(p_timers.begin()->first.time_since_epoch().count());
+        }
+    }
+
+    /* called once the task is switched out; a sooner deadline than any
+     * so far has to wake up a sleeping thread, so it can wait for it
+     */
+    void arm_timer(task *t) {
+        bool first;
+        {
+            std::lock_guard<std::mutex> l{p_lock};
+            t->p_timer = p_timers.emplace(t->p_deadline, t);
+            t->p_intimer = true;
+            first = (t->p_timer == p_timers.begin());
+            update_next_timer();
+        }
+        if (first && p_idle.load()) {
+            p_cond.notify_one();
+        }
+    }
+
+    void disarm_timer(task *t) {
+        std::lock_guard<std::mutex> l{p_lock};
+        if (t->p_intimer) {
+            p_timers.erase(t->p_timer);
+            t->p_intimer = false;
+            update_next_timer();
+        }
+    }
+
+    /* the state is changed under the timer lock, so a woken up task can
+     * never be timed out by a stale timer from its previous wait
+     */
+    void fire_timers(worker &w) {
+        auto next = p_tnext.load(std::memory_order_relaxed);
+        if (next == NO_TIMER) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now.time_since_epoch().count() < next) {
+            return;
+        }
         for (;;) {
-            std::unique_lock<std::mutex> l{p_lock};
-            /* wait for an item to become available */
-            while (p_available.empty()) {
-                /* if all lists have become empty, we're done */
-                if (p_waiting.empty() && p_running.empty()) {
+            task *t;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                if (p_timers.empty() || (p_timers.begin()->first > now)) {
                     return;
                 }
-                p_cond.wait(l);
+                t = p_timers.begin()->second;
+                p_timers.erase(p_timers.begin());
+                t->p_intimer = false;
+                update_next_timer();
+                auto st = wake_state::WAITING;
+                if (!t->p_wstate.compare_exchange_strong(
+                    st, wake_state::TIMED_OUT
+                )) {
+                    continue;
+                }
             }
-            task_run(l);
+            if (task_cond *c = t->waiting_on; c) {
+                c->lock();
+                c->unlink(t);
+                c->unlock();
+                t->waiting_on = nullptr;
+            }
+            schedule(t, false, &w);
         }
     }
 
-    void task_run(std::unique_lock<std::mutex> &l) {
-        auto it = p_available.begin();
-        p_running.splice(p_running.cend(), p_available, it);
-        task &c = *it;
-        l.unlock();
-        c();
-        if (c.dead()) {
-            l.lock();
-            p_running.erase(it);
-            /* we're dead, notify all threads so they can be joined
-             * we check all three, saves the other threads some re-waiting
-             * when a task or tasks are already running, and those that do
-             * will do the final notify by themselves
+    task *take(worker &w) {
+        task *t = nullptr;
+        {
+            std::lock_guard<std::mutex> l{w.p_lock};
+            if (!w.p_queue.empty()) {
+                t = w.p_queue.front();
+                w.p_queue.pop_front();
+            }
+        }
+        if (!t && p_ninject.load()) {
+            auto l = p_stats.lock(p_lock);
+            if (!p_inject.empty()) {
+                t = p_inject.front();
+                p_inject.pop_front();
+                p_ninject.fetch_sub(1);
+            }
+        }
+        if (!t && (p_workers.size() > 1)) {
+            /* steal from the back, starting at a random victim */
+            std::size_t n = p_workers.size();
+            std::size_t vi = w.next_victim(n);
+            for (std::size_t i = 0; !t && (i < n); ++i, vi = (vi + 1) % n) {
+                worker &v = *p_workers[vi];
+                if (&v == &w) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> l{v.p_lock};
+                auto it = std::find_if(
+                    v.p_queue.rbegin(), v.p_queue.rend(), [](task *vt) {
+                        return !vt->p_pin;
+                    }
+                );
+                if (it != v.p_queue.rend()) {
+                    t = *it;
+                    v.p_queue.erase(std::next(it).base());
+                    w.p_stats.stolen();
+                }
+            }
+        }
+        if (t) {
+            if (t->p_pin) {
+                pinned(w, -1);
+            }
+            p_pending.fetch_sub(1);
+        }
+        return t;
+    }
+
+    void thread_run(worker &w) {
+        for (;;) {
+            fire_timers(w);
+            if (task *t = take(w); t) {
+                task_run(w, t);
+                continue;
+            }
+            auto l = p_stats.lock(p_lock);
+            /* wait for a task to become available or a timer to go off */
+            p_idle.fetch_add(1);
+            while (!runnable(w) && p_ntasks.load()) {
+                if (p_timers.empty()) {
+                    p_cond.wait(l);
+                    continue;
+                }
+                /* copied, the timer may be gone by the time we wake up */
+                auto tp = p_timers.begin()->first;
+                if (p_cond.wait_until(l, tp) == std::cv_status::timeout) {
+                    break;
+                }
+            }
+            p_idle.fetch_sub(1);
+            /* no tasks left at all, we're done */
+            if (!p_ntasks.load()) {
+                return;
+            }
+        }
+    }
+
+    void task_run(worker &w, task *t) {
+        t->p_worker = &w;
+        if (w.p_shared) {
+            t->pin(w);
+        }
+        w.p_stats.switched();
+        auto start = w.p_stats.now();
+        (*t)();
+        w.p_stats.ran(start);
+        if (t->dead()) {
+            w.p_stats.completed();
+            worker *home = t->p_home;
+            if constexpr(!SA::is_thread_safe) {
+                std::lock_guard<std::mutex> l{p_slock};
+                t->~task();
+            } else {
+                t->~task();
+            }
+            if (home && (home != &w)) {
+                home->put_remote(t);
+            } else {
+                w.put_block(t);
+            }
+            /* we're dead, and if we were the last one, wake everybody
+             * up so that the threads can finish and be joined
              */
-            if (p_available.empty() && p_waiting.empty() && p_running.empty()) {
-                l.unlock();
+            if (p_ntasks.fetch_sub(1) == 1) {
+                {
+                    std::lock_guard<std::mutex> l{p_lock};
+                }
                 p_cond.notify_all();
             }
-        } else if (!c.waiting_on) {
-            /* reschedule to the end of the queue */
-            l.lock();
-            p_available.splice(p_available.cend(), p_running, it);
-            l.unlock();
-            p_cond.notify_one();
+        } else if (task_cond *c = t->waiting_on; c) {
+            /* the task is now fully switched out, so add it to the wait
+             * queue; the condvar was locked in wait, so unlock it here
+             */
+            if (c->p_wlast) {
+                c->p_wlast->next_waiting = t;
+            } else {
+                c->p_waiting = t;
+            }
+            c->p_wlast = t;
+            /* arm the timer before any notify can get to the task */
+            if (t->p_timed) {
+                arm_timer(t);
+            }
+            c->unlock();
+        } else if (t->p_timed) {
+            arm_timer(t);
         } else {
-            p_waiting.splice(p_waiting.cbegin(), p_running, it);
-            c.next_waiting = c.waiting_on->p_waiting;
-            c.waiting_on->p_waiting = &c;
-            /* wait locks the mutex, so manually unlock it here */
-            p_lock.unlock();
+            reschedule(w, t);
         }
     }
 
     std::size_t p_threads;
     std::condition_variable p_cond;
     std::mutex p_lock;
+    std::mutex p_slock;
     SA p_stacks;
-    tlist p_available;
-    tlist p_waiting;
-    tlist p_running;
+    detail::thread_placer p_placer;
+    detail::sched_counters p_stats;
+    std::vector<std::unique_ptr<worker>> p_workers;
+    std::deque<task *> p_inject;
+    std::atomic<std::size_t> p_ninject{0};
+    std::atomic<std::size_t> p_ntasks{0};
+    std::atomic<std::size_t> p_pending{0};
+    std::atomic<std::size_t> p_idle{0};
+    std::atomic<std::size_t> p_pinned{0};
+    std::size_t p_sstack = 0;
+    timer_map p_timers;
+    std::atomic<std::chrono::steady_clock::rep> p_tnext{NO_TIMER};
+
+    static constexpr auto NO_TIMER =
+        std::numeric_limits<std::chrono::steady_clock::rep>::max();
 };
 
-/** @brief An ostd::basic_coroutine_scheduler using ostd::stack_pool. */
-using coroutine_scheduler = basic_coroutine_scheduler<stack_pool>;
+/** @brief An ostd::basic_coroutine_scheduler using a concurrent stack pool.
+ *
+ * The pool is ostd::concurrent_stack_pool.
+ */
+using coroutine_scheduler = basic_coroutine_scheduler<concurrent_stack_pool>;
 
 /** @brief Spawns a task on the currently in use scheduler.
  *
@@ -1129,12 +2241,545 @@ inline tid<std::result_of_t<F(A...)>> spawn(F &&func, A &&...args) {
     );
 }
 
+/** @brief The result of ostd::when_any().
+ *
+ * The `Seq` template parameter is the sequence of `tid`s passed in, i.e.
+ * either an `std::tuple` or an `std::vector` of them.
+ */
+template<typename Seq>
+struct when_any_result {
+    /** @brief The index of the first finished `tid` in the sequence.
+     *
+     * If the sequence is empty, this is `std::size_t(-1)`.
+     */
+    std::size_t index;
+
+    /** @brief The `tid`s passed in. */
+    Seq tids;
+};
+
+namespace detail {
+    struct tid_access {
+        template<typename T>
+        static tid_base *state(tid<T> &t) noexcept {
+            return t.p_state;
+        }
+
+        template<typename T>
+        static tid<T> make(tid_impl<T> *st) noexcept {
+            return tid<T>{st};
+        }
+    };
+
+    /* doubles as the continuation of the antecedent, which holds
+     * a reference to it until it's spawned
+     */
+    template<typename R, typename F>
+    struct tid_then: tid_task<R, F>, tid_cont {
+        using tid_task<R, F>::tid_task;
+
+        void ready() noexcept {
+            scheduler *s = this->get_scheduler();
+            if (!s) {
+                this->run();
+                this->release();
+                return;
+            }
+            try {
+                s->do_spawn([this]() {
+                    this->run();
+                    this->release();
+                });
+            } catch (...) {
+                this->fail(std::current_exception());
+                this->release();
+            }
+        }
+    };
+
+    inline generic_condvar current_condition() {
+        if (current_scheduler) {
+            return current_scheduler->make_condition();
+        }
+        return generic_condvar{};
+    }
+
+    template<typename T, typename F>
+    inline void when_each(std::vector<tid<T>> &seq, F &func) {
+        for (auto &t: seq) {
+            func(t);
+        }
+    }
+
+    template<typename ...T, typename F>
+    inline void when_each(std::tuple<tid<T>...> &seq, F &func) {
+        std::apply([&func](auto &...ts) {
+            (func(ts), ...);
+        }, seq);
+    }
+
+    /* every antecedent gets a node of its own, the state is deleted
+     * once all of them have been called, which may be well after the
+     * result is complete in case of when_any
+     */
+    template<bool Any, typename Seq>
+    struct when_state {
+        using result = std::conditional_t<Any, when_any_result<Seq>, Seq>;
+
+        struct node: tid_cont {
+            void ready() noexcept {
+                p_parent->ready(p_idx);
+            }
+
+            when_state *p_parent;
+            tid_base *p_base;
+            std::size_t p_idx;
+        };
+
+        when_state(Seq &seq, std::size_t n):
+            p_seq(std::move(seq)), p_nodes(new node[n]), p_left(n)
+        {
+            std::size_t i = 0;
+            auto set = [this, &i](auto &t) {
+                p_nodes[i].p_parent = this;
+                p_nodes[i].p_base = tid_access::state(t);
+                p_nodes[i].p_idx = i;
+                ++i;
+            };
+            when_each(p_seq, set);
+        }
+
+        void start(tid_promise<result> *res) {
+            p_res = res;
+            /* the state may be gone as soon as the last one is set */
+            for (std::size_t i = 0, n = p_left; i < n; ++i) {
+                auto &nd = p_nodes[i];
+                nd.p_base->set_cont(&nd);
+            }
+        }
+
+        void ready(std::size_t idx) noexcept {
+            if constexpr(Any) {
+                if (!p_fired.exchange(true)) {
+                    auto func = [this, idx]() {
+                        return result{idx, std::move(p_seq)};
+                    };
+                    p_res->complete(func);
+                    p_res->release();
+                }
+                if (p_left.fetch_sub(1) == 1) {
+                    delete this;
+                }
+            } else if (p_left.fetch_sub(1) == 1) {
+                auto func = [this]() {
+                    return std::move(p_seq);
+                };
+                p_res->complete(func);
+                p_res->release();
+                delete this;
+            }
+        }
+
+    private:
+        Seq p_seq;
+        std::unique_ptr<node[]> p_nodes;
+        tid_promise<result> *p_res = nullptr;
+        std::atomic<std::size_t> p_left;
+        std::atomic<bool> p_fired{false};
+    };
+
+    template<bool Any, typename Seq>
+    inline auto when_start(Seq &seq, std::size_t n) {
+        using S = when_state<Any, Seq>;
+        using R = typename S::result;
+        auto mkcond = []() {
+            return current_condition();
+        };
+        auto *res = new tid_promise<R>{mkcond, current_scheduler};
+        auto ret = tid_access::make<R>(res);
+        if (!n) {
+            auto func = [&seq]() {
+                if constexpr(Any) {
+                    return R{std::size_t(-1), std::move(seq)};
+                } else {
+                    return std::move(seq);
+                }
+            };
+            res->complete(func);
+            return ret;
+        }
+        auto *st = new S{seq, n};
+        res->retain();
+        st->start(res);
+        return ret;
+    }
+} /* namespace detail */
+
+template<typename T>
+template<typename F>
+inline tid<std::result_of_t<F(tid<T>)>> tid<T>::then(F func) {
+    using R = std::result_of_t<F(tid<T>)>;
+    detail::tid_base *ante = p_state;
+    scheduler *s = ante->get_scheduler();
+    auto mkcond = [s]() {
+        if (s) {
+            return s->make_condition();
+        }
+        return generic_condvar{};
+    };
+    auto cfunc = [t = std::move(*this), f = std::move(func)]() mutable -> R {
+        return f(std::move(t));
+    };
+    auto *st = new detail::tid_then<R, decltype(cfunc)>{
+        mkcond, std::move(cfunc), s
+    };
+    auto ret = detail::tid_access::make<R>(st);
+    /* the antecedent's reference, handed over to the task once spawned */
+    st->retain();
+    ante->set_cont(st);
+    return ret;
+}
+
+/** @brief Waits for all of the given tasks without blocking anybody.
+ *
+ * Returns a `tid` that becomes ready once all of the given tasks are
+ * finished; its result is a tuple of the given `tid`s, all finished by
+ * then, so the individual results and exceptions can be retrieved with
+ * their get(). Like with tid::then(), nothing is left waiting for the
+ * tasks in the meantime; attach a continuation to the result to act
+ * on it without blocking either.
+ *
+ * All of the `tid`s must be valid and are moved into the result.
+ *
+ * @see ostd::when_any(), tid::then()
+ */
+template<typename ...T>
+inline tid<std::tuple<tid<T>...>> when_all(tid<T> &&...tids) {
+    std::tuple<tid<T>...> seq{std::move(tids)...};
+    return detail::when_start<false>(seq, sizeof...(T));
+}
+
+/** @brief Waits for all of the given tasks without blocking anybody.
+ *
+ * Like when_all(tid<T> &&...), but for any number of tasks with the
+ * same result type. The result is the vector of `tid`s passed in.
+ */
+template<typename T>
+inline tid<std::vector<tid<T>>> when_all(std::vector<tid<T>> tids) {
+    std::size_t n = tids.size();
+    return detail::when_start<false>(tids, n);
+}
+
+/** @brief Waits for any of the given tasks without blocking anybody.
+ *
+ * Returns a `tid` that becomes ready once the first of the given tasks
+ * is finished. Its result is an ostd::when_any_result containing the
+ * index of that task along with a tuple of all the given `tid`s; the
+ * others may or may not be finished by then.
+ *
+ * All of the `tid`s must be valid and are moved into the result.
+ *
+ * @see ostd::when_all(), tid::then()
+ */
+template<typename ...T>
+inline tid<when_any_result<std::tuple<tid<T>...>>> when_any(
+    tid<T> &&...tids
+) {
+    std::tuple<tid<T>...> seq{std::move(tids)...};
+    return detail::when_start<true>(seq, sizeof...(T));
+}
+
+/** @brief Waits for any of the given tasks without blocking anybody.
+ *
+ * Like when_any(tid<T> &&...), but for any number of tasks with the
+ * same result type.
+ */
+template<typename T>
+inline tid<when_any_result<std::vector<tid<T>>>> when_any(
+    std::vector<tid<T>> tids
+) {
+    std::size_t n = tids.size();
+    return detail::when_start<true>(tids, n);
+}
+
+/** @brief A handle to the cancellation state of an ostd::task_group.
+ *
+ * Tokens are cheap to copy and keep the state alive on their own, so they
+ * can be passed around freely, e.g. to code that is not a part of the
+ * group but wants to observe or trigger the cancellation.
+ *
+ * @see ostd::task_group::token()
+ */
+struct cancellation_token {
+    /** @brief Cancels the associated group.
+     *
+     * @see ostd::task_group::cancel()
+     */
+    void cancel() noexcept {
+        p_state->cancel();
+    }
+
+    /** @brief Checks if the associated group has been cancelled. */
+    bool cancelled() const noexcept {
+        return p_state->cancelled();
+    }
+
+    /** @brief Throws ostd::task_cancelled if cancelled() is true. */
+    void check() const {
+        p_state->check();
+    }
+
+private:
+    friend struct task_group;
+
+    cancellation_token(std::shared_ptr<detail::cancel_state> st) noexcept:
+        p_state(std::move(st))
+    {}
+
+    std::shared_ptr<detail::cancel_state> p_state;
+};
+
+namespace detail {
+    /* shared with the children, as they may outlive the group object
+     * for a moment when notifying it of their end
+     */
+    struct group_state {
+        template<typename F>
+        group_state(F &func): p_cond(func()) {}
+
+        template<typename F>
+        void run(F &func) {
+            if (!p_cancel.cancelled()) {
+                cancel_state *cs = swap_current_cancel(&p_cancel);
+                try {
+                    func();
+                } catch (task_cancelled const &) {
+                    /* that's what it's for */
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                swap_current_cancel(cs);
+            }
+            done();
+        }
+
+        void fail(std::exception_ptr e) noexcept {
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                if (!p_eptr) {
+                    p_eptr = std::move(e);
+                }
+            }
+            p_cancel.cancel();
+        }
+
+        /* notified unlocked, as that may switch tasks */
+        void done() noexcept {
+            bool last;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                last = !--p_running;
+            }
+            if (last) {
+                p_cond.notify_all();
+            }
+        }
+
+        cancel_state p_cancel;
+        /* the link to the parent state; kept here and not in the group, as
+         * the group may be on a shared stack that's copied away
+         */
+        cancel_waiter p_link;
+        std::mutex p_lock;
+        generic_condvar p_cond;
+        std::exception_ptr p_eptr;
+        std::size_t p_running = 0;
+    };
+}
+
+/** @brief A group of tasks that succeed or fail together.
+ *
+ * Tasks spawned in a group can be waited for all at once. Once any of
+ * them fails by throwing an exception, the group gets cancelled: the
+ * tasks that have not started yet are not run at all and the ones that
+ * are running get ostd::task_cancelled thrown out of their next
+ * cancellation point, i.e. ostd::yield(), ostd::cancellation_point() or
+ * a wait on a channel. The first exception is then rethrown by wait().
+ *
+ * Cancellation is cooperative. A task that never reaches a cancellation
+ * point runs to completion. Groups created inside a task of another group
+ * are cancelled along with it.
+ *
+ * The group must be created inside a scheduler and can only be used from
+ * within it. It is neither copyable nor movable.
+ */
+struct task_group {
+    /** @brief Creates an empty group on the current scheduler. */
+    task_group():
+        p_state(std::make_shared<detail::group_state>(mkcond)),
+        p_parent(detail::current_cancel())
+    {
+        if (p_parent) {
+            p_state->p_link.p_child = &p_state->p_cancel;
+            p_parent->add(p_state->p_link);
+        }
+    }
+
+    task_group(task_group const &) = delete;
+    task_group &operator=(task_group const &) = delete;
+
+    /** @brief Cancels the group unless it's done and waits for it.
+     *
+     * Any exception is dropped at this point; call wait() first to
+     * get it.
+     */
+    ~task_group() {
+        bool running;
+        {
+            std::lock_guard<std::mutex> l{p_state->p_lock};
+            running = (p_state->p_running != 0);
+        }
+        if (running) {
+            cancel();
+        }
+        try {
+            wait();
+        } catch (...) {}
+        if (p_parent) {
+            p_parent->remove(p_state->p_link);
+        }
+    }
+
+    /** @brief Spawns a task in the group.
+     *
+     * The arguments are bound to the function first, like with
+     * ostd::spawn(). Any exception thrown by the task cancels the group
+     * and is stored for wait(). If the group has been cancelled by the
+     * time the task gets to run, it's not run at all.
+     */
+    template<typename F, typename ...A>
+    void spawn(F func, A &&...args) {
+        auto st = p_state;
+        {
+            std::lock_guard<std::mutex> l{st->p_lock};
+            ++st->p_running;
+        }
+        try {
+            if constexpr(sizeof...(A) == 0) {
+                detail::current_scheduler->spawn(
+                    [st, f = std::move(func)]() mutable {
+                        st->run(f);
+                    }
+                );
+            } else {
+                detail::current_scheduler->spawn(
+                    [st, f = std::bind(
+                        std::move(func), std::forward<A>(args)...
+                    )]() mutable {
+                        st->run(f);
+                    }
+                );
+            }
+        } catch (...) {
+            st->done();
+            throw;
+        }
+    }
+
+    /** @brief Waits for all tasks in the group to finish.
+     *
+     * If any of them has failed, the first exception is rethrown and
+     * forgotten, so the group can be waited for again.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> l{p_state->p_lock};
+        while (p_state->p_running) {
+            p_state->p_cond.wait(l);
+        }
+        if (p_state->p_eptr) {
+            std::rethrow_exception(std::exchange(p_state->p_eptr, nullptr));
+        }
+    }
+
+    /** @brief Cancels the group.
+     *
+     * Tasks that have not started yet will not be run and new tasks
+     * will not be run either; running tasks are left to reach their
+     * next cancellation point. Cancellation cannot be undone.
+     */
+    void cancel() noexcept {
+        p_state->p_cancel.cancel();
+    }
+
+    /** @brief Checks if the group has been cancelled. */
+    bool cancelled() const noexcept {
+        return p_state->p_cancel.cancelled();
+    }
+
+    /** @brief Gets a token for the group's cancellation state. */
+    cancellation_token token() const noexcept {
+        return cancellation_token{std::shared_ptr<detail::cancel_state>{
+            p_state, &p_state->p_cancel
+        }};
+    }
+
+private:
+    static generic_condvar mkcond() {
+        return detail::current_condition();
+    }
+
+    std::shared_ptr<detail::group_state> p_state;
+    detail::cancel_state *p_parent;
+};
+
+/** @brief Throws ostd::task_cancelled if the current task is cancelled.
+ *
+ * Only tasks of an ostd::task_group can be cancelled. Long computations
+ * that never wait or yield may call this once in a while to cooperate.
+ */
+inline void cancellation_point() {
+    if (auto *cs = detail::current_cancel(); cs) {
+        cs->check();
+    }
+}
+
 /** @brief Tells the current scheduler to re-schedule the current task.
  *
- * Effectively calls scheduler::yield().
+ * Effectively calls scheduler::yield(). This is a cancellation point,
+ * so ostd::task_cancelled may be thrown after the task gets to run again.
  */
-inline void yield() noexcept {
+inline void yield() {
     detail::current_scheduler->yield();
+    cancellation_point();
+}
+
+/** @brief Suspends the current task for at least the given duration.
+ *
+ * Effectively calls scheduler::sleep_for(). With a coroutine based
+ * scheduler, only the calling task is suspended and the thread keeps
+ * running other tasks, unlike with `std::this_thread::sleep_for()`.
+ * Outside of a scheduler, this just puts the calling thread to sleep.
+ */
+template<typename R, typename P>
+inline void sleep_for(std::chrono::duration<R, P> const &dur) {
+    if (detail::current_scheduler) {
+        detail::current_scheduler->sleep_for(dur);
+    } else {
+        std::this_thread::sleep_for(dur);
+    }
+}
+
+/** @brief Suspends the current task until the given time point.
+ *
+ * Effectively calls scheduler::sleep_until(). See ostd::sleep_for().
+ */
+template<typename C, typename D>
+inline void sleep_until(std::chrono::time_point<C, D> const &tp) {
+    if (detail::current_scheduler) {
+        detail::current_scheduler->sleep_until(tp);
+    } else {
+        std::this_thread::sleep_until(tp);
+    }
 }
 
 /** @brief Creates a channel with the currently in use scheduler.
@@ -1149,6 +2794,80 @@ inline channel<T> make_channel() {
     return detail::current_scheduler->make_channel<T>();
 }
 
+/** @brief Creates a bounded channel with the currently in use scheduler.
+ *
+ * Effectively calls scheduler::make_bounded_channel().
+ *
+ * @tparam T The type of the channel value.
+ *
+ */
+template<typename T>
+inline bounded_channel<T> make_bounded_channel(std::size_t cap) {
+    return detail::current_scheduler->make_bounded_channel<T>(cap);
+}
+
+/** @brief Waits until any of the given channels is ready.
+ *
+ * The channels can be any mix of ostd::channel and ostd::bounded_channel.
+ * A channel is ready when it has a value to get or when it's closed. If
+ * none of them is ready, the calling task is suspended until one of them
+ * becomes ready, using a condition variable from the current scheduler
+ * (or std::condition_variable when called outside of a scheduler), so
+ * there is no polling involved.
+ *
+ * Nothing is taken out of the channels. When several tasks read from the
+ * same channel, another task may get the value first, so the returned
+ * channel should typically be read with `try_get()`, calling select()
+ * again when there is nothing, and handling ostd::channel_error when the
+ * channel has been closed.
+ *
+ * @returns The index of the first ready channel in the argument list.
+ */
+template<typename ...C>
+inline std::size_t select(C &...chans) {
+    static_assert(sizeof...(C) > 0, "select needs at least one channel");
+    auto mkcond = []() {
+        return detail::current_condition();
+    };
+    auto sel = std::make_shared<detail::chan_selector>(mkcond);
+    constexpr std::size_t nchans = sizeof...(C);
+    for (;;) {
+        /* register with every channel, checking each at the same time */
+        std::size_t nreg = 0, ready = nchans;
+        auto add = [&sel, &nreg, &ready](auto &ch) {
+            if (ready != nchans) {
+                return;
+            }
+            if (detail::chan_access::state(ch).add_selector(sel)) {
+                ready = nreg;
+            } else {
+                ++nreg;
+            }
+        };
+        (add(chans), ...);
+        auto unreg = [&sel, nreg, &chans...]() {
+            std::size_t n = 0;
+            auto rem = [&sel, nreg, &n](auto &ch) {
+                if (n++ < nreg) {
+                    detail::chan_access::state(ch).remove_selector(sel.get());
+                }
+            };
+            (rem(chans), ...);
+        };
+        if (ready != nchans) {
+            unreg();
+            return ready;
+        }
+        try {
+            sel->wait();
+        } catch (...) {
+            unreg();
+            throw;
+        }
+        unreg();
+    }
+}
+
 /** @brief Creates a coroutine with the currently in use scheduler.
  *
  * Effectively calls scheduler::make_coroutine().
@@ -1177,10 +2896,217 @@ inline void reserve_stacks(std::size_t n) {
     detail::current_scheduler->reserve_stacks(n);
 }
 
+inline void trim_stacks(std::size_t keep = 0) noexcept {
+    detail::current_scheduler->trim_stacks(keep);
+}
+
+#ifdef OSTD_BUILD_TESTS
+/* tasks spawned from a task go to the queue of its thread, so they can
+ * only run anywhere else when an idle worker steals them
+ */
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    std::vector<std::thread::id> ids;
+    std::mutex lock;
+    coroutine_scheduler{4}.start([&ids, &lock]() {
+        std::vector<tid<void>> tids;
+        for (int i = 0; i < 16; ++i) {
+            tids.push_back(spawn([&ids, &lock]() {
+                /* hold the thread, so that the others go idle and steal */
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                std::lock_guard<std::mutex> l{lock};
+                ids.push_back(std::this_thread::get_id());
+            }));
+        }
+        for (auto &t: tids) {
+            t.get();
+        }
+    });
+    fail_if_not(ids.size() == 16);
+    std::sort(ids.begin(), ids.end());
+    fail_if_not(std::unique(ids.begin(), ids.end()) - ids.begin() > 1);
+}
+
+/* a put from a plain thread wakes up the task waiting for it */
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    int got = coroutine_scheduler{4}.start([]() {
+        auto ch = make_channel<int>();
+        auto bch = make_bounded_channel<int>(2);
+        std::thread thr{[ch, bch]() mutable {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            ch.put(40);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            bch.put(2);
+        }};
+        int ret = ch.get();
+        ret += bch.get();
+        thr.join();
+        return ret;
+    });
+    fail_if_not(got == 42);
+}
+
+/* timed waits that expire and ones that are signalled in time */
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if;
+    using ostd::test::fail_if_not;
+    using namespace std::chrono_literals;
+    using sclock = std::chrono::steady_clock;
+    coroutine_scheduler{4}.start([]() {
+        auto ch = make_channel<int>();
+        auto t0 = sclock::now();
+        fail_if(ch.try_get_for(10ms).has_value());
+        fail_if_not((sclock::now() - t0) >= 10ms);
+        t0 = sclock::now();
+        ostd::sleep_for(5ms);
+        fail_if_not((sclock::now() - t0) >= 5ms);
+        /* signalled long before the deadline */
+        auto t = spawn([ch]() mutable {
+            ostd::sleep_for(5ms);
+            ch.put(5);
+        });
+        t0 = sclock::now();
+        auto v = ch.try_get_for(10s);
+        fail_if_not(v && (*v == 5) && ((sclock::now() - t0) < 5s));
+        t.get();
+        /* a mix; every value is either taken in time or left over, and
+         * every waiter comes back exactly once
+         */
+        auto res = make_channel<int>();
+        constexpr int nwait = 64, nput = 32;
+        for (int i = 0; i < nwait; ++i) {
+            spawn([ch, res, i]() mutable {
+                auto got = ch.try_get_for(std::chrono::milliseconds(i % 8));
+                res.put(got ? 1 : 0);
+            });
+        }
+        for (int i = 0; i < nput; ++i) {
+            ch.put(i);
+            if (!(i % 4)) {
+                ostd::sleep_for(1ms);
+            }
+        }
+        int taken = 0;
+        for (int i = 0; i < nwait; ++i) {
+            taken += res.get();
+        }
+        int left = 0;
+        while (ch.try_get()) {
+            ++left;
+        }
+        fail_if_not((taken + left) == nput);
+    });
+}
+
+/* the last task exits while the other workers are parked, with and
+ * without timers around; start() has to come back every time
+ */
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    using namespace std::chrono_literals;
+    int n = 0;
+    for (int i = 0; i < 50; ++i) {
+        n += coroutine_scheduler{4}.start([i]() {
+            if (i % 2) {
+                ostd::sleep_for(1ms);
+            } else {
+                spawn([]() {
+                    ostd::sleep_for(2ms);
+                });
+            }
+            return 1;
+        });
+    }
+    fail_if_not(n == 50);
+}
+
+namespace detail {
+    /* every level has a frame with a pattern of its own and switches on
+     * the way back up, so the copy of the stack keeps changing in size
+     */
+    template<typename F>
+    inline bool test_shared_frames(int id, int depth, F &sw) {
+        volatile unsigned char buf[256];
+        for (int i = 0; i < 256; ++i) {
+            buf[i] = static_cast<unsigned char>(id * 31 + depth * 7 + i);
+        }
+        bool ret = true;
+        if (depth > 0) {
+            ret = test_shared_frames(id, depth - 1, sw);
+        } else {
+            sw();
+        }
+        sw();
+        for (int i = 0; i < 256; ++i) {
+            if (buf[i] != static_cast<unsigned char>(id * 31 + depth * 7 + i)) {
+                ret = false;
+            }
+        }
+        return ret;
+    }
+} /* namespace detail */
+
+/* tasks of different depths taking turns on the shared stack, through
+ * both yield and channels; a producer goes as deep as its consumer is
+ * shallow and the other way around, and each checks its own locals
+ * after every switch
+ */
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    auto test_tasks = []() {
+        std::vector<tid<bool>> tids;
+        int id = 0;
+        for (auto [dp, dc]: { std::pair{64, 0}, {0, 64}, {8, 32}, {1, 1} }) {
+            auto ch = make_channel<int>();
+            int total = dp + 2;
+            tids.push_back(spawn([ch, dp = dp, id]() mutable {
+                int n = 0;
+                auto sw = [&ch, &n]() {
+                    ch.put(n++);
+                    yield();
+                };
+                return detail::test_shared_frames(id, dp, sw) && (n == dp + 2);
+            }));
+            tids.push_back(spawn([ch, dc = dc, id, total]() mutable {
+                int n = 0;
+                bool seq = true;
+                auto sw = [&ch, &n, &seq, total]() {
+                    if (n < total) {
+                        seq = seq && (ch.get() == n++);
+                    } else {
+                        yield();
+                    }
+                };
+                bool ret = detail::test_shared_frames(id + 1, dc, sw);
+                while (n < total) {
+                    sw();
+                }
+                return ret && seq;
+            }));
+            id += 2;
+        }
+        bool ret = true;
+        for (auto &t: tids) {
+            ret = t.get() && ret;
+        }
+        return ret;
+    };
+    simple_coroutine_scheduler ss;
+    ss.set_shared_stack(stack_traits::default_size());
+    fail_if_not(ss.start(test_tasks));
+    coroutine_scheduler cs{4};
+    cs.set_shared_stack(stack_traits::default_size());
+    fail_if_not(cs.start(test_tasks));
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
 
+#undef OSTD_TEST_MODULE
+
 #endif
 
 /** @} */
@@ -19,15 +19,27 @@
 #define OSTD_CONTEXT_STACK_HH
 
 #include <cstddef>
+#include <cstdint>
 #include <new>
+#include <memory>
 #include <algorithm>
+#include <type_traits>
 
+#ifdef OSTD_BUILD_TESTS
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+#include <ostd/unit_test.hh>
 #include <ostd/platform.hh>
 
 #ifdef OSTD_USE_VALGRIND
 #  include <valgrind/valgrind.h>
 #endif
 
+#define OSTD_TEST_MODULE libostd_context_stack
+
 namespace ostd {
 
 /** @addtogroup Concurrency
@@ -84,6 +96,11 @@ struct stack_context {
  *
  * This structure allows stack allocators (and potentially others) to check
  * various properties of stacks on your system, mainly sizing-wise.
+ *
+ * Traits can also change how the stack memory is mapped, by having static
+ * constexpr booleans `huge_pages` and `no_reserve`; see the derived
+ * ostd::huge_page_stack_traits and ostd::large_stack_traits. They're both
+ * off when not present, as is the case here.
  */
 struct OSTD_EXPORT stack_traits {
     /** @brief Checks if the stack is unbounded.
@@ -134,13 +151,101 @@ struct OSTD_EXPORT stack_traits {
     static std::size_t default_size() noexcept;
 };
 
+/** @brief Stack traits asking for memory backed by huge pages.
+ *
+ * The memory of each allocation is backed by huge pages where the system
+ * supports it (explicitly reserved ones via `MAP_HUGETLB` if there are
+ * any, transparent huge pages via `madvise()` otherwise). This saves TLB
+ * entries when many stacks are in use, but only makes sense with stack
+ * pools, whose chunks should be a multiple of the huge page size (which
+ * is usually 2 MiB, the size of a default chunk of default stacks).
+ * Allocations smaller than a huge page are done as usual.
+ *
+ * Protected stacks never use `MAP_HUGETLB`, as their guard pages could
+ * not be set up within huge pages.
+ */
+struct huge_page_stack_traits: stack_traits {
+    /** @brief Huge pages are requested. */
+    static constexpr bool huge_pages = true;
+};
+
+/** @brief Stack traits for big stacks that only cost what is used.
+ *
+ * The memory is mapped without reserving swap space for it (with
+ * `MAP_NORESERVE`), so the default size of 8 MiB (or the maximum,
+ * if that's lower) is merely address space until it's touched. This
+ * is good for coroutines that may recurse deeply, without making all
+ * the other ones expensive.
+ */
+struct large_stack_traits: stack_traits {
+    /** @brief No swap space is reserved. */
+    static constexpr bool no_reserve = true;
+
+    /** @brief Gets the default size for stacks, 8 MiB. */
+    static std::size_t default_size() noexcept {
+        std::size_t r = std::max(
+            std::size_t(8 * 1024 * 1024), stack_traits::minimum_size()
+        );
+        if (stack_traits::is_unbounded()) {
+            return r;
+        }
+        return std::min(r, stack_traits::maximum_size());
+    }
+};
+
 namespace detail {
-    OSTD_EXPORT void *stack_alloc(std::size_t sz);
+    constexpr unsigned int STACK_HUGE_PAGES = 1 << 0;
+    constexpr unsigned int STACK_NO_RESERVE = 1 << 1;
+    constexpr unsigned int STACK_PROTECTED = 1 << 2;
+
+    template<typename T, typename = void>
+    constexpr bool stack_huge_pages = false;
+
+    template<typename T>
+    constexpr bool stack_huge_pages<
+        T, std::void_t<decltype(T::huge_pages)>
+    > = T::huge_pages;
+
+    template<typename T, typename = void>
+    constexpr bool stack_no_reserve = false;
+
+    template<typename T>
+    constexpr bool stack_no_reserve<
+        T, std::void_t<decltype(T::no_reserve)>
+    > = T::no_reserve;
+
+    template<typename Traits, bool Protected>
+    constexpr unsigned int stack_flags =
+        (stack_huge_pages<Traits> ? STACK_HUGE_PAGES : 0) |
+        (stack_no_reserve<Traits> ? STACK_NO_RESERVE : 0) |
+        (Protected ? STACK_PROTECTED : 0);
+
+    OSTD_EXPORT void *stack_alloc(std::size_t sz, unsigned int flags = 0);
     OSTD_EXPORT void stack_free(void *p, std::size_t sz) noexcept;
     OSTD_EXPORT void stack_protect(void *p, std::size_t sz) noexcept;
+    OSTD_EXPORT void stack_release(void *p, std::size_t sz) noexcept;
+    OSTD_EXPORT std::size_t stack_resident(void *p, std::size_t sz) noexcept;
     OSTD_EXPORT std::size_t stack_main_size() noexcept;
 }
 
+/** @brief The memory use of a stack pool.
+ *
+ * Returned from the `stats()` method of the stack pools.
+ */
+struct stack_pool_stats {
+    /** @brief The number of stacks the pool has room for. */
+    std::size_t stacks = 0;
+    /** @brief The number of those that are not given out. */
+    std::size_t unused = 0;
+    /** @brief The bytes of address space taken up by the pool. */
+    std::size_t reserved = 0;
+    /** @brief The bytes of the pool that are in physical memory.
+     *
+     * Where this can't be found out, it's the same as reserved.
+     */
+    std::size_t resident = 0;
+};
+
 /** @brief A fixed size stack.
  *
  * A normal stack with a fixed size. The size of stacks alloated by this
@@ -200,7 +305,9 @@ struct basic_fixedsize_stack {
         std::size_t pgs = Traits::page_size();
         std::size_t asize = ss + pgs - 1 - (ss - 1) % pgs + (pgs * Protected);
 
-        void *p = detail::stack_alloc(asize);
+        void *p = detail::stack_alloc(
+            asize, detail::stack_flags<Traits, Protected>
+        );
         if constexpr(Protected) {
             /* a single guard page */
             detail::stack_protect(p, pgs);
@@ -235,6 +342,13 @@ struct basic_fixedsize_stack {
      */
     void reserve(std::size_t) {}
 
+    /** @brief A no-op function for stack pool uses.
+     *
+     * Stacks are freed as soon as they're deallocated, so there is never
+     * anything to trim.
+     */
+    void trim(std::size_t = 0) noexcept {}
+
     /** @brief Gets the allocator for stack pool uses.
      *
      * Since this is not a stack pool, this function returns a copy of
@@ -255,6 +369,13 @@ using fixedsize_stack = basic_fixedsize_stack<stack_traits, false>;
 /** @brief A protected fixed size stack using ostd::stack_traits. */
 using protected_fixedsize_stack = basic_fixedsize_stack<stack_traits, true>;
 
+/** @brief An unprotected fixed size stack using ostd::large_stack_traits. */
+using large_fixedsize_stack = basic_fixedsize_stack<large_stack_traits, false>;
+
+/** @brief A protected fixed size stack using ostd::large_stack_traits. */
+using protected_large_fixedsize_stack =
+    basic_fixedsize_stack<large_stack_traits, true>;
+
 /** @brief A stack pool.
  *
  * A stack pool allocates multiple stacks at a time and gives them out as
@@ -269,6 +390,10 @@ using protected_fixedsize_stack = basic_fixedsize_stack<stack_traits, true>;
  * The allocated stacks are fixed size and allocated exactly the same as
  * ostd::basic_fixedsize_stack would.
  *
+ * Unused stacks can be given back to the system with trim(), either by
+ * hand or automatically once there are too many of them, see
+ * set_high_watermark().
+ *
  * Keep in mind that stack pools are not thread safe, so external locking
  * has to be done (see is_thread_safe).
  *
@@ -351,12 +476,19 @@ public:
     basic_stack_pool(basic_stack_pool &&p) noexcept {
         p_chunk = p.p_chunk;
         p_unused = p.p_unused;
+        p_released = p.p_released;
         p_chunksize = p.p_chunksize;
         p_stacksize = p.p_stacksize;
         p_capacity = p.p_capacity;
+        p_nunused = p.p_nunused;
+        p_nreleased = p.p_nreleased;
+        p_highwm = p.p_highwm;
         p.p_chunk = nullptr;
         p.p_unused = nullptr;
+        p.p_released = nullptr;
         p.p_capacity = 0;
+        p.p_nunused = 0;
+        p.p_nreleased = 0;
     }
 
     /** @brief Stack pools are not copy assignable. */
@@ -396,7 +528,106 @@ public:
             return;
         }
         std::size_t cnum = p_chunksize / p_stacksize;
-        p_unused = alloc_chunks(p_unused, (n - cap + cnum - 1) / cnum);
+        std::size_t nch = (n - cap + cnum - 1) / cnum;
+        p_unused = alloc_chunks(p_unused, nch);
+        p_nunused += nch * cnum;
+    }
+
+    /** @brief Gives the memory of unused stacks back to the system.
+     *
+     * Keeps at most `keep` unused stacks ready for use. Chunks where none
+     * of the stacks are in use are freed as a whole as long as at least
+     * `keep` unused stacks remain. The other unused stacks stay in the
+     * pool, but their memory is released (using `madvise()` on POSIX
+     * systems), so they take up no physical memory until they're used
+     * again. The page at the top of each such stack is kept, as the pool
+     * keeps track of it there.
+     *
+     * @see set_high_watermark()
+     */
+    void trim(std::size_t keep = 0) noexcept {
+        std::size_t ss = p_stacksize;
+        std::size_t cnum = p_chunksize / ss;
+        std::size_t unused = p_nunused + p_nreleased;
+        /* mark the chunks to free first, then take their stacks off the
+         * lists, so that everything is only walked once
+         */
+        std::size_t nfree = 0;
+        for (void *pc = p_chunk; pc;) {
+            if ((unused < keep) || ((unused - keep) < cnum)) {
+                break;
+            }
+            stack_node *fnd = get_node(pc, ss, 1);
+            if (fnd->nfree == cnum) {
+                fnd->nfree = CHUNK_DEAD;
+                unused -= cnum;
+                ++nfree;
+            }
+            pc = fnd->next_chunk;
+        }
+        if (nfree) {
+            p_nunused -= unlink_dead(p_unused);
+            p_nreleased -= unlink_dead(p_released);
+            for (void **pc = &p_chunk; *pc;) {
+                stack_node *fnd = get_node(*pc, ss, 1);
+                if (fnd->nfree != CHUNK_DEAD) {
+                    pc = &fnd->next_chunk;
+                    continue;
+                }
+                void *dead = *pc;
+                *pc = fnd->next_chunk;
+                detail::stack_free(dead, p_chunksize);
+            }
+            p_capacity -= nfree * cnum;
+        }
+        /* the most recently used stacks are the likeliest to be warm */
+        stack_node **pn = &p_unused;
+        for (std::size_t i = 0; *pn && (i < keep); ++i) {
+            pn = &(*pn)->next;
+        }
+        std::size_t pgs = Traits::page_size();
+        for (stack_node *nd = *pn; nd;) {
+            stack_node *next = nd->next;
+            auto *top = reinterpret_cast<unsigned char *>(nd);
+            auto *p = top + sizeof(stack_node) - ss;
+            std::size_t rsize = std::size_t(top - p) / pgs * pgs;
+            if (rsize) {
+                detail::stack_release(p, rsize);
+            }
+            nd->next = p_released;
+            p_released = nd;
+            --p_nunused;
+            ++p_nreleased;
+            nd = next;
+        }
+        *pn = nullptr;
+    }
+
+    /** @brief Sets the number of unused stacks to trim at.
+     *
+     * Once more than `n` stacks are unused after one is returned to the
+     * pool, the pool is trimmed down to half of that, see trim(). By
+     * default there is no limit. Released stacks don't count.
+     */
+    void set_high_watermark(std::size_t n) noexcept {
+        p_highwm = n;
+    }
+
+    /** @brief Gets the memory use of the pool.
+     *
+     * Finding out the resident size needs a system call for every chunk
+     * (`mincore()` on POSIX systems), so this is not very cheap.
+     */
+    stack_pool_stats stats() const noexcept {
+        stack_pool_stats ret;
+        ret.stacks = p_capacity;
+        ret.unused = p_nunused + p_nreleased;
+        for (void *pc = p_chunk; pc;) {
+            ret.reserved += p_chunksize;
+            ret.resident += detail::stack_resident(pc, p_chunksize);
+            pc = get_node(pc, p_stacksize, 1)->next_chunk;
+        }
+        return ret;
     }
 
     /** @brief Requests a stack directly from the pool.
@@ -435,6 +666,10 @@ public:
         stack_node *unused = p_unused;
         nd->next = unused;
         p_unused = nd;
+        ++nd->first->nfree;
+        if (++p_nunused > p_highwm) {
+            trim(p_highwm / 2);
+        }
     }
 
     /** @brief Swaps two stack pools. */
@@ -442,9 +677,13 @@ public:
         using std::swap;
         swap(p_chunk, p.p_chunk);
         swap(p_unused, p.p_unused);
+        swap(p_released, p.p_released);
         swap(p_chunksize, p.p_chunksize);
         swap(p_stacksize, p.p_stacksize);
         swap(p_capacity, p.p_capacity);
+        swap(p_nunused, p.p_nunused);
+        swap(p_nreleased, p.p_nreleased);
+        swap(p_highwm, p.p_highwm);
     }
 
     /** @brief Gets a stack allocator that uses the pool.
@@ -458,26 +697,39 @@ public:
     }
 
 private:
+    /* every stack knows the first one of its chunk, which keeps the link
+     * to the next chunk and how many stacks of its own chunk are unused
+     */
     struct stack_node {
         void *next_chunk;
         stack_node *next;
+        stack_node *first;
+        std::size_t nfree;
     };
 
+    /* marks a chunk to be freed by trim() */
+    static constexpr std::size_t CHUNK_DEAD = ~std::size_t(0);
+
     stack_node *alloc_chunks(stack_node *un, std::size_t n) {
         std::size_t ss = p_stacksize;
         std::size_t cs = p_chunksize;
         std::size_t cnum = cs / ss;
 
         for (std::size_t ci = 0; ci < n; ++ci) {
-            void *chunk = detail::stack_alloc(cs);
+            void *chunk = detail::stack_alloc(
+                cs, detail::stack_flags<Traits, Protected>
+            );
+            auto *fnd = get_node(chunk, ss, 1);
             stack_node *prevn = un;
             for (std::size_t i = cnum; i >= 2; --i) {
                 auto nd = get_node(chunk, ss, i);
                 nd->next_chunk = nullptr;
                 nd->next = prevn;
+                nd->first = fnd;
                 prevn = nd;
             }
-            auto *fnd = get_node(chunk, ss, 1);
+            fnd->first = fnd;
+            fnd->nfree = cnum;
             fnd->next_chunk = p_chunk;
             /* write every time so that a potential failure results
              * in all previously allocated chunks being freed in dtor
@@ -493,14 +745,38 @@ private:
 
     stack_node *request() {
         stack_node *r = p_unused;
-        if (!r) {
+        if (r) {
+            p_unused = r->next;
+            --p_nunused;
+        } else if ((r = p_released)) {
+            p_released = r->next;
+            --p_nreleased;
+        } else {
             r = alloc_chunks(nullptr, 1);
+            p_unused = r->next;
+            p_nunused += p_chunksize / p_stacksize - 1;
         }
-        p_unused = r->next;
+        --r->first->nfree;
         return r;
     }
 
-    stack_node *get_node(void *chunk, std::size_t ssize, std::size_t n) {
+    /* takes the stacks of the chunks marked dead off the list */
+    static std::size_t unlink_dead(stack_node *&list) noexcept {
+        std::size_t ret = 0;
+        for (stack_node **pn = &list; *pn;) {
+            if ((*pn)->first->nfree == CHUNK_DEAD) {
+                *pn = (*pn)->next;
+                ++ret;
+            } else {
+                pn = &(*pn)->next;
+            }
+        }
+        return ret;
+    }
+
+    static stack_node *get_node(
+        void *chunk, std::size_t ssize, std::size_t n
+    ) noexcept {
         return reinterpret_cast<stack_node *>(
             static_cast<unsigned char *>(chunk) + (ssize * n) - sizeof(stack_node)
         );
@@ -508,10 +784,14 @@ private:
 
     void *p_chunk = nullptr;
     stack_node *p_unused = nullptr;
+    stack_node *p_released = nullptr;
 
     std::size_t p_chunksize;
     std::size_t p_stacksize;
     std::size_t p_capacity = 0;
+    std::size_t p_nunused = 0;
+    std::size_t p_nreleased = 0;
+    std::size_t p_highwm = ~std::size_t(0);
 };
 
 /** @brief Swaps two stack pools. */
@@ -528,13 +808,641 @@ using stack_pool = basic_stack_pool<stack_traits, false>;
 /** @brief A protected stack pool using ostd::stack_traits. */
 using protected_stack_pool = basic_stack_pool<stack_traits, true>;
 
+/** @brief An unprotected stack pool using ostd::huge_page_stack_traits. */
+using huge_page_stack_pool = basic_stack_pool<huge_page_stack_traits, false>;
+
+namespace detail {
+    /* kept at the top of every free stack of a concurrent pool; the count
+     * is only valid in the first node of a batch
+     */
+    struct stack_depot_node {
+        stack_depot_node *next;
+        stack_depot_node *next_batch;
+        std::size_t count;
+    };
+
+    struct stack_depot;
+
+    OSTD_EXPORT std::shared_ptr<stack_depot> stack_depot_new(
+        std::size_t ss, std::size_t cs, unsigned int flags
+    );
+    OSTD_EXPORT stack_depot_node *stack_depot_take(
+        std::shared_ptr<stack_depot> const &d
+    );
+    OSTD_EXPORT void stack_depot_put(
+        std::shared_ptr<stack_depot> const &d, stack_depot_node *nd
+    ) noexcept;
+    OSTD_EXPORT void stack_depot_reserve(
+        std::shared_ptr<stack_depot> const &d, std::size_t n
+    );
+    OSTD_EXPORT void stack_depot_trim(
+        std::shared_ptr<stack_depot> const &d, std::size_t keep,
+        std::size_t pgs
+    ) noexcept;
+    OSTD_EXPORT stack_pool_stats stack_depot_stats(
+        std::shared_ptr<stack_depot> const &d
+    ) noexcept;
+} /* namespace detail */
+
+/** @brief A stack pool that can be used from many threads at once.
+ *
+ * Like ostd::basic_stack_pool, this allocates stacks in chunks and keeps
+ * them for reuse rather than freeing them, but it can be shared by any
+ * number of threads without external locking. Every thread keeps a small
+ * cache of free stacks for each pool it uses and exchanges batches of
+ * them with a shared depot, which is lock free except when the pool has
+ * to grow; so threads that create and destroy coroutines mostly don't
+ * touch any shared state at all.
+ *
+ * A stack may be returned to the pool on a different thread than the one
+ * it was allocated on. The stacks cached by a thread go back to the depot
+ * when the thread exits. All memory is freed when the pool is destroyed,
+ * or when a thread that was returning stacks to it at the time is done.
+ * Before that, trim() can give the memory of unused stacks back to the
+ * system, but chunks are never freed.
+ *
+ * This is the stack allocator the multithreaded schedulers use by default.
+ *
+ * @tparam Traits The stack traits to use (typically ostd::stack_traits).
+ * @tparam Protected Whether to protect the stack.
+ */
+template<typename Traits, bool Protected>
+struct basic_concurrent_stack_pool {
+private:
+    struct allocator {
+        allocator() = delete;
+        allocator(basic_concurrent_stack_pool &p) noexcept: p_pool(&p) {}
+
+        stack_context allocate() {
+            return p_pool->allocate();
+        }
+
+        void deallocate(stack_context &st) noexcept {
+            p_pool->deallocate(st);
+        }
+
+    private:
+        basic_concurrent_stack_pool *p_pool;
+    };
+
+public:
+    /** @brief The default number of stacks to store in each chunk. */
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE = 32;
+
+    /** @brief The traits type used for the stacks. */
+    using traits_type = Traits;
+
+    /** @brief The allocator type for the pool.
+     *
+     * See ostd::basic_stack_pool::allocator_type.
+     */
+    using allocator_type = allocator;
+
+    /** @brief Concurrent stack pools are thread safe. */
+    static constexpr bool is_thread_safe = true;
+
+    /** @brief Creates a stack pool.
+     *
+     * The parameters are optional. The stack size defaults to the default
+     * size used for stacks according to the traits. The number of stacks
+     * in each chunk defaults to `DEFAULT_CHUNK_SIZE`.
+     *
+     * @param ss The stack size used for the individual stacks.
+     * @param cs The number of stacks in each chunk.
+     */
+    basic_concurrent_stack_pool(
+        std::size_t ss = Traits::default_size(),
+        std::size_t cs = DEFAULT_CHUNK_SIZE
+    ) {
+        std::size_t pgs = Traits::page_size();
+        std::size_t asize = ss + pgs - 1 - (ss - 1) % pgs + (pgs * Protected);
+        p_stacksize = asize;
+        p_depot = detail::stack_depot_new(
+            asize, cs, detail::stack_flags<Traits, Protected>
+        );
+    }
+
+    /** @brief Concurrent stack pools are not copy constructible. */
+    basic_concurrent_stack_pool(basic_concurrent_stack_pool const &) = delete;
+
+    /** @brief Moves the stack pool.
+     *
+     * The other pool is left without any state and must not be used
+     * for anything but destruction or assignment.
+     */
+    basic_concurrent_stack_pool(basic_concurrent_stack_pool &&p) noexcept:
+        p_depot(std::move(p.p_depot)), p_stacksize(p.p_stacksize)
+    {}
+
+    /** @brief Concurrent stack pools are not copy assignable. */
+    basic_concurrent_stack_pool &operator=(
+        basic_concurrent_stack_pool const &
+    ) = delete;
+
+    /** @brief Move assigns another pool to this one.
+     *
+     * Performs swap(basic_concurrent_stack_pool &).
+     */
+    basic_concurrent_stack_pool &operator=(
+        basic_concurrent_stack_pool &&p
+    ) noexcept {
+        swap(p);
+        return *this;
+    }
+
+    /** @brief Reserves a number of stacks.
+     *
+     * The given number is the number of stacks the pool is supposed to
+     * contain in total. If it already contains that many, this function
+     * does nothing. Otherwise it reserves some extra chunks.
+     */
+    void reserve(std::size_t n) {
+        detail::stack_depot_reserve(p_depot, n);
+    }
+
+    /** @brief Gives the memory of unused stacks back to the system.
+     *
+     * Like ostd::basic_stack_pool::trim(), but only the stacks in the
+     * shared depot are considered, not the few cached by the threads,
+     * and `keep` is rounded up to whole batches of stacks. The stacks
+     * stay in the pool, only their memory is released.
+     */
+    void trim(std::size_t keep = 0) noexcept {
+        detail::stack_depot_trim(p_depot, keep, Traits::page_size());
+    }
+
+    /** @brief Gets the memory use of the pool.
+     *
+     * The unused stacks are the ones in the shared depot, not counting
+     * the ones cached by the threads. Like with ostd::basic_stack_pool,
+     * this is not very cheap.
+     */
+    stack_pool_stats stats() const noexcept {
+        return detail::stack_depot_stats(p_depot);
+    }
+
+    /** @brief Requests a stack directly from the pool. */
+    stack_context allocate() {
+        auto *nd = detail::stack_depot_take(p_depot);
+        std::size_t ss = p_stacksize - sizeof(detail::stack_depot_node);
+        [[maybe_unused]] auto *p = reinterpret_cast<unsigned char *>(nd) - ss;
+        if constexpr(Protected) {
+            detail::stack_protect(p, Traits::page_size());
+        }
+        stack_context ret{nd, ss};
+#ifdef OSTD_USE_VALGRIND
+        ret.valgrind_id = VALGRIND_STACK_REGISTER(ret.ptr, p);
+#endif
+        return ret;
+    }
+
+    /** @brief Returns a stack back to the pool. */
+    void deallocate(stack_context &st) noexcept {
+        if (!st.ptr) {
+            return;
+        }
+#ifdef OSTD_USE_VALGRIND
+        VALGRIND_STACK_DEREGISTER(st.valgrind_id);
+#endif
+        detail::stack_depot_put(
+            p_depot, static_cast<detail::stack_depot_node *>(st.ptr)
+        );
+        st.ptr = nullptr;
+    }
+
+    /** @brief Swaps two stack pools. */
+    void swap(basic_concurrent_stack_pool &p) noexcept {
+        using std::swap;
+        swap(p_depot, p.p_depot);
+        swap(p_stacksize, p.p_stacksize);
+    }
+
+    /** @brief Gets a stack allocator that uses the pool.
+     *
+     * See ostd::basic_stack_pool::get_allocator().
+     */
+    allocator_type get_allocator() noexcept {
+        return allocator{*this};
+    }
+
+private:
+    std::shared_ptr<detail::stack_depot> p_depot;
+    std::size_t p_stacksize;
+};
+
+/** @brief Swaps two concurrent stack pools. */
+template<typename Traits, bool P>
+inline void swap(
+    basic_concurrent_stack_pool<Traits, P> &a,
+    basic_concurrent_stack_pool<Traits, P> &b
+) noexcept {
+    a.swap(b);
+}
+
+/** @brief An unprotected concurrent stack pool using ostd::stack_traits. */
+using concurrent_stack_pool = basic_concurrent_stack_pool<stack_traits, false>;
+
+/** @brief A protected concurrent stack pool using ostd::stack_traits. */
+using protected_concurrent_stack_pool =
+    basic_concurrent_stack_pool<stack_traits, true>;
+
+/** @brief An unprotected concurrent stack pool using huge pages.
+ *
+ * The traits are ostd::huge_page_stack_traits.
+ */
+using huge_page_concurrent_stack_pool =
+    basic_concurrent_stack_pool<huge_page_stack_traits, false>;
+
+/** @brief How deep the stacks measured by an ostd::stack_profiler went.
+ *
+ * The depth of a stack is the number of bytes from its top down to the
+ * deepest one that was ever written to.
+ */
+struct stack_profile {
+    /** @brief The number of histogram buckets. */
+    static constexpr std::size_t BUCKETS = 40;
+
+    /** @brief The number of stacks measured. */
+    std::uint64_t stacks = 0;
+    /** @brief The size of the biggest stack measured. */
+    std::size_t size = 0;
+    /** @brief The deepest any stack went. */
+    std::size_t max = 0;
+    /** @brief A histogram of the depths with power of two buckets.
+     *
+     * Bucket `i` counts depths of at least `2^(i-1)` and under `2^i`
+     * bytes; the first one counts unused stacks.
+     */
+    std::uint64_t counts[BUCKETS] = {};
+
+    /** @brief Gets an upper bound of the given quantile of the depths.
+     *
+     * For example, `quantile(0.99)` is a size which 99% of the stacks
+     * stayed within, exact up to a factor of two; but never bigger than
+     * the deepest one. Gives zero if nothing was measured.
+     */
+    std::size_t quantile(double q) const noexcept {
+        if (!stacks) {
+            return 0;
+        }
+        auto want = std::uint64_t(q * double(stacks));
+        std::uint64_t seen = 0;
+        std::size_t i = 0;
+        for (; i < (BUCKETS - 1); ++i) {
+            seen += counts[i];
+            if (seen > want) {
+                break;
+            }
+        }
+        return std::min(std::size_t(1) << i, max);
+    }
+};
+
+/** @brief Collects how deep stacks go for ostd::profiling_stack.
+ *
+ * This is a handle to shared state, so copies add up to the same
+ * profile, which may be done from any number of threads at once.
+ */
+struct OSTD_EXPORT stack_profiler {
+    /** @brief Creates a profiler with nothing measured yet. */
+    stack_profiler();
+
+    /** @brief Gets what has been measured so far. */
+    stack_profile get() const noexcept;
+
+    /** @brief Forgets what has been measured so far. */
+    void reset() noexcept;
+
+    /** @brief Fills a fresh stack with the pattern.
+     *
+     * The lowest `skip` bytes are not touched, so that guard pages can
+     * be left alone.
+     */
+    void fill(stack_context const &st, std::size_t skip) const noexcept;
+
+    /** @brief Measures a stack filled with fill() before and counts it. */
+    void measure(stack_context const &st, std::size_t skip) const noexcept;
+
+private:
+    struct state;
+    std::shared_ptr<state> p_state;
+};
+
+/** @brief A stack allocator that measures how much of the stacks is used.
+ *
+ * This wraps another stack allocator or pool and fills every stack it
+ * gives out with a pattern. When the stack is given back, the pattern is
+ * checked to find the deepest point the stack was used to, which is then
+ * counted in an ostd::stack_profile. This way the right stack size can be
+ * found for the coroutines or tasks using the allocator.
+ *
+ * The profile is collected by an ostd::stack_profiler, which can be kept
+ * even after the allocator has been moved into a scheduler. To tell apart
+ * different places where coroutines are created, give each of them its
+ * own allocator.
+ *
+ * Filling and checking the stacks is not cheap and touches all of their
+ * memory, so this is meant for debugging and tuning. The lowest page of
+ * every stack is left alone, as it may be a guard page, so a stack that
+ * was used that far is reported as fully used.
+ *
+ * @tparam SA The stack allocator or pool to wrap.
+ */
+template<typename SA>
+struct profiling_stack {
+private:
+    struct allocator {
+        allocator() = delete;
+        allocator(
+            typename SA::allocator_type &&a, stack_profiler prof
+        ) noexcept:
+            p_alloc(std::move(a)), p_prof(std::move(prof))
+        {}
+
+        stack_context allocate() {
+            auto st = p_alloc.allocate();
+            p_prof.fill(st, skip());
+            return st;
+        }
+
+        void deallocate(stack_context &st) noexcept {
+            if (st.ptr) {
+                p_prof.measure(st, skip());
+            }
+            p_alloc.deallocate(st);
+        }
+
+    private:
+        typename SA::allocator_type p_alloc;
+        stack_profiler p_prof;
+    };
+
+    static std::size_t skip() noexcept {
+        return SA::traits_type::page_size();
+    }
+
+public:
+    /** @brief The traits type used for the stacks. */
+    using traits_type = typename SA::traits_type;
+
+    /** @brief The allocator type, which uses the wrapped one. */
+    using allocator_type = allocator;
+
+    /** @brief Thread safe if the wrapped allocator is. */
+    static constexpr bool is_thread_safe = SA::is_thread_safe;
+
+    /** @brief Wraps the given stack allocator with a new profiler. */
+    profiling_stack(SA &&sa = SA{}): p_stacks(std::move(sa)) {}
+
+    /** @brief Wraps the given stack allocator using the given profiler. */
+    profiling_stack(SA &&sa, stack_profiler prof):
+        p_stacks(std::move(sa)), p_prof(std::move(prof))
+    {}
+
+    /** @brief Allocates a stack and fills it. */
+    stack_context allocate() {
+        auto st = p_stacks.allocate();
+        p_prof.fill(st, skip());
+        return st;
+    }
+
+    /** @brief Measures a stack and deallocates it. */
+    void deallocate(stack_context &st) noexcept {
+        if (st.ptr) {
+            p_prof.measure(st, skip());
+        }
+        p_stacks.deallocate(st);
+    }
+
+    /** @brief Reserves stacks in the wrapped allocator. */
+    void reserve(std::size_t n) {
+        p_stacks.reserve(n);
+    }
+
+    /** @brief Trims the wrapped allocator. */
+    void trim(std::size_t keep = 0) noexcept {
+        p_stacks.trim(keep);
+    }
+
+    /** @brief Gets an allocator using the wrapped one's allocator. */
+    allocator_type get_allocator() noexcept {
+        return allocator{p_stacks.get_allocator(), p_prof};
+    }
+
+    /** @brief Gets the profiler, which can be kept around. */
+    stack_profiler profiler() const noexcept {
+        return p_prof;
+    }
+
+    /** @brief Gets what has been measured so far. */
+    stack_profile profile() const noexcept {
+        return p_prof.get();
+    }
+
+private:
+    SA p_stacks;
+    stack_profiler p_prof{};
+};
+
 /** @brief The default stack allocator to use when none is provided. */
 using default_stack = fixedsize_stack;
 
+#ifdef OSTD_BUILD_TESTS
+namespace detail {
+    /* tags both ends of the usable part of a stack, leaving out the
+     * guard page of protected pools
+     */
+    inline void test_stack_tag(stack_context const &st, std::size_t tag) {
+        auto *p = static_cast<unsigned char *>(st.ptr);
+        reinterpret_cast<std::size_t *>(p)[-1] = tag;
+        *reinterpret_cast<std::size_t *>(
+            p - st.size + stack_traits::page_size()
+        ) = ~tag;
+    }
+
+    inline bool test_stack_tagged(stack_context const &st, std::size_t tag) {
+        auto *p = static_cast<unsigned char *>(st.ptr);
+        return (reinterpret_cast<std::size_t *>(p)[-1] == tag) && (
+            *reinterpret_cast<std::size_t *>(
+                p - st.size + stack_traits::page_size()
+            ) == ~tag
+        );
+    }
+
+    inline bool test_stacks_distinct(std::vector<stack_context> const &sts) {
+        std::vector<void *> ps;
+        for (auto &st: sts) {
+            ps.push_back(st.ptr);
+        }
+        std::sort(ps.begin(), ps.end());
+        return std::adjacent_find(ps.begin(), ps.end()) == ps.end();
+    }
+
+    template<typename P>
+    inline bool test_pool_idle(P const &p) {
+        auto st = p.stats();
+        return st.unused == st.stacks;
+    }
+} /* namespace detail */
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    auto test_cross = [](auto &p) {
+        /* enough for the batches to overflow the slots into the spill list */
+        std::vector<stack_context> sts(1000);
+        std::thread{[&p, &sts]() {
+            for (std::size_t i = 0; i < sts.size(); ++i) {
+                sts[i] = p.allocate();
+                detail::test_stack_tag(sts[i], i);
+            }
+        }}.join();
+        fail_if_not(detail::test_stacks_distinct(sts));
+        bool tagged = true;
+        std::thread{[&p, &sts, &tagged]() {
+            for (std::size_t i = 0; i < sts.size(); ++i) {
+                tagged = tagged && detail::test_stack_tagged(sts[i], i);
+                p.deallocate(sts[i]);
+            }
+        }}.join();
+        fail_if_not(tagged);
+        std::size_t cap = p.stats().stacks;
+        fail_if_not(cap >= sts.size());
+        fail_if_not(detail::test_pool_idle(p));
+        /* the second round is served from what the first one gave back */
+        std::thread{[&p, &sts]() {
+            for (std::size_t i = 0; i < sts.size(); ++i) {
+                sts[i] = p.allocate();
+                detail::test_stack_tag(sts[i], i);
+            }
+        }}.join();
+        fail_if_not(detail::test_stacks_distinct(sts));
+        fail_if_not(p.stats().stacks == cap);
+        std::thread{[&p, &sts, &tagged]() {
+            for (std::size_t i = sts.size(); i-- > 0;) {
+                tagged = tagged && detail::test_stack_tagged(sts[i], i);
+                p.deallocate(sts[i]);
+            }
+        }}.join();
+        fail_if_not(tagged);
+        fail_if_not(detail::test_pool_idle(p));
+    };
+    concurrent_stack_pool p1{16384, 8};
+    test_cross(p1);
+    protected_concurrent_stack_pool p2{16384, 8};
+    test_cross(p2);
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    /* the thread exits with the stacks still in its cache */
+    concurrent_stack_pool p{16384, 8};
+    bool cached = false;
+    std::thread{[&p, &cached]() {
+        stack_context sts[5];
+        for (auto &st: sts) {
+            st = p.allocate();
+        }
+        for (auto &st: sts) {
+            p.deallocate(st);
+        }
+        cached = !detail::test_pool_idle(p);
+    }}.join();
+    fail_if_not(cached);
+    fail_if_not(detail::test_pool_idle(p));
+    /* more pools than a thread caches at once, so some get evicted */
+    std::vector<concurrent_stack_pool> ps;
+    for (std::size_t i = 0; i < 6; ++i) {
+        ps.emplace_back(16384, 8);
+    }
+    std::thread{[&ps]() {
+        for (std::size_t r = 0; r < 3; ++r) {
+            for (auto &pp: ps) {
+                auto st = pp.allocate();
+                pp.deallocate(st);
+            }
+        }
+    }}.join();
+    for (auto &pp: ps) {
+        fail_if_not(detail::test_pool_idle(pp));
+    }
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    /* the pool dies while the threads still cache stacks from it */
+    auto p = std::make_unique<concurrent_stack_pool>(16384, 8);
+    std::atomic<int> phase{0};
+    auto wait_for = [&phase](int n) {
+        while (phase.load() != n) {
+            std::this_thread::yield();
+        }
+    };
+    auto use = [](concurrent_stack_pool &pp) {
+        std::vector<stack_context> sts(20);
+        for (auto &st: sts) {
+            st = pp.allocate();
+        }
+        for (auto &st: sts) {
+            pp.deallocate(st);
+        }
+    };
+    bool reused = false;
+    std::thread t1{[&]() {
+        use(*p);
+        ++phase;
+        wait_for(3);
+        /* the new pool may well get the address of the dead one */
+        concurrent_stack_pool np{16384, 8};
+        use(np);
+        std::size_t cap = np.stats().stacks;
+        use(np);
+        reused = (np.stats().stacks == cap);
+    }};
+    std::thread t2{[&]() {
+        use(*p);
+        ++phase;
+        wait_for(3);
+    }};
+    wait_for(2);
+    p.reset();
+    ++phase;
+    t1.join();
+    t2.join();
+    fail_if_not(reused);
+}
+
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    /* returning stacks from a thread local destroyed after the cache */
+    struct late_user {
+        concurrent_stack_pool *pool = nullptr;
+        ~late_user() {
+            if (pool) {
+                auto st1 = pool->allocate();
+                auto st2 = pool->allocate();
+                pool->deallocate(st1);
+                pool->deallocate(st2);
+            }
+        }
+    };
+    concurrent_stack_pool p{16384, 8};
+    std::thread{[&p]() {
+        /* constructed before the cache, so destroyed after it */
+        static thread_local late_user lu;
+        lu.pool = &p;
+        auto st = p.allocate();
+        p.deallocate(st);
+    }}.join();
+    fail_if_not(detail::test_pool_idle(p));
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
 
+#undef OSTD_TEST_MODULE
+
 #endif
 
 /** @} */
@@ -76,6 +76,45 @@ namespace detail {
         }
         SA p_alloc;
     };
+
+    struct shared_stack;
+
+    /* the buffer a coroutine's part of a shared stack is copied out to,
+     * the saved bytes follow right after it
+     */
+    struct stack_copy {
+        shared_stack *stack;
+        void (*entry)(transfer_t);
+        std::size_t size;
+        std::size_t cap;
+    };
+
+    /* an execution stack several coroutines of one thread take turns on;
+     * the one that ran last stays on it until another one needs it, only
+     * then is the used part of its stack copied out, and it's copied back
+     * in once it's resumed, so its frames always live at the same address
+     */
+    struct OSTD_EXPORT shared_stack {
+        shared_stack(stack_context st) noexcept: p_stack(st) {}
+
+        shared_stack(shared_stack const &) = delete;
+        shared_stack &operator=(shared_stack const &) = delete;
+
+        /* puts the coroutine's stack in place; never call this while
+         * running on the shared stack, the copies would clobber it
+         */
+        void swap_in(coroutine_context &c);
+
+        /* forgets the coroutine if it's the one on the stack */
+        void release(coroutine_context &c) noexcept {
+            if (p_owner == &c) {
+                p_owner = nullptr;
+            }
+        }
+
+        stack_context p_stack;
+        coroutine_context *p_owner = nullptr;
+    };
 } /* namespace detail */
 
 /** @brief An encapsulated context any coroutine-type inherits from.
@@ -146,6 +185,9 @@ protected:
      * @see yield_jump(), yield_done()
      */
     void coro_jump() {
+        if (p_copy) {
+            swap_stack();
+        }
         auto tfer = detail::ostd_jump_fcontext(p_coro, this);
         p_coro = tfer.ctx;
         p_state = state(std::size_t(tfer.data));
@@ -242,7 +284,51 @@ protected:
         }
     }
 
+    /** @brief Creates a context on a shared stack.
+     *
+     * Like make_context(), but instead of having a stack of its own, the
+     * coroutine runs on a stack shared with other coroutines of the same
+     * thread. The used part of the stack is copied out to a buffer sized
+     * to fit once another coroutine needs the stack and copied back in
+     * before the coroutine is resumed, so a suspended coroutine takes up
+     * only as much memory as it actually uses.
+     *
+     * Since the stack is only in place while the coroutine is running,
+     * nothing outside of it may access objects on its stack while it's
+     * suspended. The coroutine may only be called or destroyed from the
+     * thread owning the stack, and never from another coroutine on it.
+     *
+     * The stack may be null, in which case bind_stack() has to be called
+     * before the first call.
+     *
+     * @param[in] ss The shared stack, it has to outlive the coroutine.
+     * @tparam C The coroutine type that inherits from the context class.
+     */
+    template<typename C>
+    void make_shared_context(detail::shared_stack *ss) {
+        make_copy(ss, &context_call<C, detail::shared_stack>);
+    }
+
+    /** @brief Checks if the coroutine is waiting for a shared stack.
+     *
+     * That is, if it was created with a null shared stack and bind_stack()
+     * was not called yet.
+     */
+    bool needs_stack() const noexcept {
+        return p_copy && !p_copy->stack;
+    }
+
+    /** @brief Sets the shared stack of a coroutine that needs one.
+     *
+     * @see needs_stack()
+     */
+    void bind_stack(detail::shared_stack &ss) noexcept {
+        p_copy->stack = &ss;
+    }
+
 private:
+    friend struct detail::shared_stack;
+
     struct forced_unwind {
         detail::transfer_t tfer;
         forced_unwind(detail::transfer_t t): tfer(t) {}
@@ -263,6 +349,9 @@ private:
             /* this coroutine never got to live :( */
             return;
         }
+        if (p_copy) {
+            swap_stack();
+        }
         detail::ostd_ontop_fcontext(
             std::exchange(p_coro, nullptr), this,
             [](detail::transfer_t t) -> detail::transfer_t {
@@ -273,6 +362,14 @@ private:
 
     void free_stack() {
         using SF = detail::stack_free_iface;
+        if (p_copy) {
+            free_copy();
+            return;
+        }
+        if (!p_sfree) {
+            return;
+        }
+        p_sfree->free(p_stack);
         if (static_cast<void *>(p_sfree) == &p_salloc) {
             p_sfree->~SF();
         } else {
@@ -280,6 +377,21 @@ private:
         }
     }
 
+    /* the coroutine that ran last stays on the stack, so resuming it
+     * right away again costs nothing
+     */
+    void swap_stack() {
+        auto *ss = p_copy->stack;
+        if (ss->p_owner != this) {
+            ss->swap_in(*this);
+        }
+    }
+
+    void make_copy(
+        detail::shared_stack *ss, void (*entry)(detail::transfer_t)
+    );
+    void free_copy() noexcept;
+
     template<typename C, typename SA>
     static void context_call(detail::transfer_t t) {
         auto &self = *(static_cast<C *>(t.data));
@@ -305,10 +417,11 @@ private:
 
     /* 3 pointer big is enough to cover just about any allocator */
     std::aligned_storage_t<sizeof(void *) * 3> p_salloc;
-    detail::stack_free_iface *p_sfree;
+    detail::stack_free_iface *p_sfree = nullptr;
     stack_context p_stack;
     detail::fcontext_t p_coro = nullptr;
     detail::fcontext_t p_orig = nullptr;
+    detail::stack_copy *p_copy = nullptr;
     std::exception_ptr p_except;
     state p_state = state::HOLD;
 };
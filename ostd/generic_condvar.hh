@@ -12,8 +12,13 @@
 #ifndef OSTD_GENERIC_CONDVAR_HH
 #define OSTD_GENERIC_CONDVAR_HH
 
+#include <cstdint>
 #include <type_traits>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <condition_variable>
 
 #include <ostd/platform.hh>
@@ -24,15 +29,76 @@ namespace ostd {
  * @{
  */
 
+/** @brief Enables or disables spinning in the default condvar.
+ *
+ * A default constructed ostd::generic_condvar (which is also what
+ * ostd::thread_scheduler uses) spins for a short while before blocking
+ * the thread in an untimed wait, as a wakeup that comes within a few
+ * microseconds is much cheaper to catch that way than by parking and
+ * unparking the thread. How long it spins adapts to how long the recent
+ * waits on the condvar took, up to a small bound, and a wait that spins
+ * in vain is followed by one that blocks right away.
+ *
+ * Spinning is enabled by default when there is more than one CPU, and
+ * the setting applies to all condvars at once.
+ *
+ * @see condvar_spin()
+ */
+OSTD_EXPORT void set_condvar_spin(bool enable) noexcept;
+
+/** @brief Checks whether the default condvar spins before blocking.
+ *
+ * @see set_condvar_spin()
+ */
+OSTD_EXPORT bool condvar_spin() noexcept;
+
 namespace detail {
+    /* timed waits all end up using the steady clock */
+    template<typename C, typename D>
+    inline std::chrono::steady_clock::time_point steady_deadline(
+        std::chrono::time_point<C, D> const &tp
+    ) {
+        using sclock = std::chrono::steady_clock;
+        if constexpr(std::is_same_v<C, sclock>) {
+            return std::chrono::ceil<sclock::duration>(tp);
+        } else {
+            return sclock::now() + std::chrono::ceil<sclock::duration>(
+                tp - C::now()
+            );
+        }
+    }
+
+    template<typename R, typename P>
+    inline std::chrono::steady_clock::time_point steady_deadline(
+        std::chrono::duration<R, P> const &dur
+    ) {
+        using sclock = std::chrono::steady_clock;
+        return sclock::now() + std::chrono::ceil<sclock::duration>(dur);
+    }
+
     struct OSTD_EXPORT cond_iface {
         cond_iface() {}
         virtual ~cond_iface();
         virtual void notify_one() = 0;
         virtual void notify_all() = 0;
         virtual void wait(std::unique_lock<std::mutex> &) = 0;
+        virtual std::cv_status wait_until(
+            std::unique_lock<std::mutex> &,
+            std::chrono::steady_clock::time_point const &
+        ) = 0;
     };
 
+    template<typename C, typename = void>
+    constexpr bool cond_has_wait_until = false;
+
+    template<typename C>
+    constexpr bool cond_has_wait_until<C, std::void_t<decltype(
+        std::declval<C &>().wait_until(
+            std::declval<std::unique_lock<std::mutex> &>(),
+            std::declval<std::chrono::steady_clock::time_point const &>()
+        )
+    )>> = true;
+
     template<typename C>
     struct cond_impl: cond_iface {
         cond_impl(): p_cond() {}
@@ -47,9 +113,71 @@ namespace detail {
         void wait(std::unique_lock<std::mutex> &l) {
             p_cond.wait(l);
         }
+        std::cv_status wait_until(
+            std::unique_lock<std::mutex> &l,
+            std::chrono::steady_clock::time_point const &tp
+        ) {
+            if constexpr(cond_has_wait_until<C>) {
+                return p_cond.wait_until(l, tp);
+            } else {
+                /* no timed wait, so the deadline is only checked once
+                 * something wakes the waiter up
+                 */
+                p_cond.wait(l);
+                if (std::chrono::steady_clock::now() >= tp) {
+                    return std::cv_status::timeout;
+                }
+                return std::cv_status::no_timeout;
+            }
+        }
     private:
         C p_cond;
     };
+
+    /* the waiter announces itself and spins on the epoch, which notifiers
+     * only bump when somebody is spinning; either way the wait returns
+     * with the lock taken again, as parking after spinning could miss a
+     * wakeup that came in the meantime, so the caller checks its condition
+     * and the next wait blocks unless there was a notification since
+     *
+     * timed waits don't spin, they're used for timeouts rather than
+     * handoffs
+     */
+    struct OSTD_EXPORT spin_cond {
+        spin_cond() {}
+
+        void notify_one() {
+            bump();
+            p_cond.notify_one();
+        }
+
+        void notify_all() {
+            bump();
+            p_cond.notify_all();
+        }
+
+        void wait(std::unique_lock<std::mutex> &l);
+
+        std::cv_status wait_until(
+            std::unique_lock<std::mutex> &l,
+            std::chrono::steady_clock::time_point const &tp
+        ) {
+            return p_cond.wait_until(l, tp);
+        }
+
+    private:
+        void bump() noexcept {
+            if (p_spinners.load()) {
+                p_epoch.fetch_add(1);
+            }
+        }
+
+        std::condition_variable p_cond;
+        std::atomic<std::uint32_t> p_epoch{0};
+        std::atomic<std::uint32_t> p_spinners{0};
+        /* nanoseconds to spin for, adjusted after every spin */
+        std::atomic<std::uint32_t> p_budget{2000};
+    };
 } /* namespace detail */
 
 /** @brief A generic condition variable type.
@@ -63,14 +191,26 @@ namespace detail {
  * template it.
  *
  * The storage for the custom type is at least 6 pointers, depending on
- * the size of a standard std::condition_variable (if it's bigger, the
- * space is the size of that).
+ * the size of the default condvar, which wraps a std::condition_variable
+ * (if it's bigger, the space is the size of that).
+ *
+ * Custom condvar types need to provide `notify_one()`, `notify_all()`
+ * and `wait(l)`. They should also provide `wait_until(l, tp)`, where `tp`
+ * is always a time point of `std::chrono::steady_clock` (other clocks are
+ * converted); without it, timed waits fall back to `wait(l)` and report
+ * a timeout only if the deadline has passed by the time they wake up, so
+ * they don't return on their own.
  */
 struct generic_condvar {
-    /** @brief Constructs the condvar using std::condition_variable. */
+    /** @brief Constructs the condvar using std::condition_variable.
+     *
+     * Untimed waits spin for a bit before blocking the thread, see
+     * ostd::set_condvar_spin(). As with any condvar, a wait may then
+     * return without a notification, so it should be done in a loop.
+     */
     generic_condvar() {
         new (reinterpret_cast<void *>(&p_condbuf))
-            detail::cond_impl<std::condition_variable>();
+            detail::cond_impl<detail::spin_cond>();
     }
 
     /** @brief Constructs the condvar using a custom type.
@@ -139,15 +279,234 @@ struct generic_condvar {
         reinterpret_cast<detail::cond_iface *>(&p_condbuf)->wait(l);
     }
 
+    /** @brief Blocks the current thread until woken up or a deadline.
+     *
+     * Like wait(std::unique_lock<std::mutex> &), but stops waiting once
+     * the given time point has been reached. Time points of clocks other
+     * than `std::chrono::steady_clock` are converted to it first, so the
+     * stored condvar only ever deals with the steady clock.
+     *
+     * @returns `std::cv_status::timeout` if the deadline has passed,
+     *          `std::cv_status::no_timeout` otherwise.
+     *
+     * @see wait_for()
+     */
+    template<typename C, typename D>
+    std::cv_status wait_until(
+        std::unique_lock<std::mutex> &l,
+        std::chrono::time_point<C, D> const &tp
+    ) {
+        return reinterpret_cast<detail::cond_iface *>(&p_condbuf)->wait_until(
+            l, detail::steady_deadline(tp)
+        );
+    }
+
+    /** @brief Blocks the current thread until woken up or a timeout.
+     *
+     * Equivalent to wait_until() with the current time plus `dur`.
+     *
+     * @see wait_until()
+     */
+    template<typename R, typename P>
+    std::cv_status wait_for(
+        std::unique_lock<std::mutex> &l, std::chrono::duration<R, P> const &dur
+    ) {
+        return reinterpret_cast<detail::cond_iface *>(&p_condbuf)->wait_until(
+            l, detail::steady_deadline(dur)
+        );
+    }
+
 private:
-    static constexpr auto cvars = sizeof(std::condition_variable);
+    static constexpr auto cvars = sizeof(detail::spin_cond);
     static constexpr auto icvars =
-        sizeof(detail::cond_impl<std::condition_variable>);
+        sizeof(detail::cond_impl<detail::spin_cond>);
     std::aligned_storage_t<std::max(
         6 * sizeof(void *) + (icvars - cvars), icvars
     )> p_condbuf;
 };
 
+namespace detail {
+    struct cancel_state;
+
+    /* the cancellation state of the running task, if any; tasks may move
+     * between threads, so these are out of line to make sure the thread
+     * local storage is looked up again every time
+     */
+    OSTD_EXPORT cancel_state *current_cancel() noexcept;
+    OSTD_EXPORT cancel_state *swap_current_cancel(cancel_state *cs) noexcept;
+
+    [[noreturn]] OSTD_EXPORT void throw_cancelled();
+
+    /* lets others run while spinning, yielding the task if in one */
+    OSTD_EXPORT void cancel_relax() noexcept;
+
+    /* either a wait to be woken up or a nested state to be cancelled */
+    struct cancel_waiter {
+        std::mutex *p_lock = nullptr;
+        generic_condvar *p_cond = nullptr;
+        cancel_state *p_child = nullptr;
+        cancel_waiter *p_prev = nullptr;
+        cancel_waiter *p_next = nullptr;
+    };
+
+    /* the lock order is state, then waiter; so waiters are registered
+     * and removed with their own lock released, and then check the flag
+     * with the lock held before every wait, which makes waking them up
+     * under their lock race free
+     *
+     * the list stays locked while the waiters are notified, which may
+     * switch tasks, so it's a spinlock that yields rather than a mutex
+     * that would block the thread with the lock holder suspended on it
+     */
+    struct cancel_state {
+        bool cancelled() const noexcept {
+            return p_cancelled.load(std::memory_order_acquire);
+        }
+
+        void check() const {
+            if (cancelled()) {
+                throw_cancelled();
+            }
+        }
+
+        void cancel() noexcept {
+            if (p_cancelled.exchange(true)) {
+                return;
+            }
+            lock();
+            for (auto *w = p_waiters; w; w = w->p_next) {
+                if (w->p_child) {
+                    w->p_child->cancel();
+                    continue;
+                }
+                {
+                    std::lock_guard<std::mutex> wl{*w->p_lock};
+                }
+                w->p_cond->notify_all();
+            }
+            unlock();
+        }
+
+        void add(cancel_waiter &w) noexcept {
+            lock();
+            w.p_prev = nullptr;
+            w.p_next = p_waiters;
+            if (p_waiters) {
+                p_waiters->p_prev = &w;
+            }
+            p_waiters = &w;
+            unlock();
+            if (w.p_child && cancelled()) {
+                w.p_child->cancel();
+            }
+        }
+
+        void remove(cancel_waiter &w) noexcept {
+            lock();
+            if (w.p_prev) {
+                w.p_prev->p_next = w.p_next;
+            } else {
+                p_waiters = w.p_next;
+            }
+            if (w.p_next) {
+                w.p_next->p_prev = w.p_prev;
+            }
+            unlock();
+        }
+
+    private:
+        void lock() noexcept {
+            while (p_locked.exchange(true, std::memory_order_acquire)) {
+                while (p_locked.load(std::memory_order_relaxed)) {
+                    cancel_relax();
+                }
+            }
+        }
+
+        void unlock() noexcept {
+            p_locked.store(false, std::memory_order_release);
+        }
+
+        cancel_waiter *p_waiters = nullptr;
+        std::atomic<bool> p_locked{false};
+        std::atomic<bool> p_cancelled{false};
+    };
+
+    /* makes a wait on a condvar a cancellation point of the running task;
+     * tasks with no cancellation state only pay for a single lookup, the
+     * others allocate the waiter, as the stack of a waiting task may be
+     * shared and copied away while another one cancels it
+     */
+    struct cancel_scope {
+        cancel_scope(std::mutex &mtx, generic_condvar &cond) noexcept:
+            p_lock(&mtx), p_cond(&cond)
+        {}
+
+        cancel_scope(cancel_scope const &) = delete;
+        cancel_scope &operator=(cancel_scope const &) = delete;
+
+        ~cancel_scope() {
+            if (p_state) {
+                p_state->remove(*p_waiter);
+            }
+        }
+
+        /* must be called with the lock released */
+        void arm() {
+            p_armed = true;
+            if (auto *cs = current_cancel(); cs) {
+                make_waiter();
+                p_state = cs;
+                p_state->add(*p_waiter);
+            }
+        }
+
+        /* for wait loops, called with the lock held right before waiting;
+         * the first time around it arms the scope, and if that meant
+         * dropping the lock, it returns false and the caller has to check
+         * its condition again; throws if the task has been cancelled
+         */
+        bool can_wait(std::unique_lock<std::mutex> &l) {
+            if (!p_armed) {
+                p_armed = true;
+                if (auto *cs = current_cancel(); cs) {
+                    make_waiter();
+                    p_state = cs;
+                    l.unlock();
+                    p_state->add(*p_waiter);
+                    l.lock();
+                    return false;
+                }
+            }
+            check();
+            return true;
+        }
+
+        bool cancelled() const noexcept {
+            return p_state && p_state->cancelled();
+        }
+
+        void check() const {
+            if (p_state) {
+                p_state->check();
+            }
+        }
+
+    private:
+        void make_waiter() {
+            p_waiter = std::make_unique<cancel_waiter>();
+            p_waiter->p_lock = p_lock;
+            p_waiter->p_cond = p_cond;
+        }
+
+        std::mutex *p_lock;
+        generic_condvar *p_cond;
+        std::unique_ptr<cancel_waiter> p_waiter;
+        cancel_state *p_state = nullptr;
+        bool p_armed = false;
+    };
+} /* namespace detail */
+
 /** @} */
 
 } /* namespace ostd */
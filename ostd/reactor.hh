@@ -0,0 +1,260 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file reactor.hh
+ *
+ * @brief An I/O reactor for waiting on file descriptors without blocking.
+ *
+ * This file implements a reactor, which allows tasks of the concurrency
+ * system to perform I/O on pipes, sockets and similar file descriptors
+ * without blocking the thread they run on. A read or write that would
+ * block parks the calling task until the descriptor becomes ready.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_REACTOR_HH
+#define OSTD_REACTOR_HH
+
+#include <cstddef>
+#include <memory>
+#include <system_error>
+
+#include <ostd/unit_test.hh>
+#include <ostd/platform.hh>
+#include <ostd/io.hh>
+
+#ifdef OSTD_BUILD_TESTS
+#include <vector>
+#include <ostd/concurrency.hh>
+#  ifdef OSTD_PLATFORM_LINUX
+#    include <unistd.h>
+#  endif
+#endif
+
+#define OSTD_TEST_MODULE libostd_reactor
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief Thrown on reactor errors, such as a failed system call. */
+struct OSTD_EXPORT reactor_error: std::system_error {
+    using std::system_error::system_error;
+    /* empty, for vtable placement */
+    virtual ~reactor_error();
+};
+
+/** @brief An I/O reactor for file descriptors.
+ *
+ * The reactor watches registered file descriptors on a thread of its own
+ * (using epoll on Linux) and wakes up the tasks waiting for them. Waiting
+ * is done through a condition variable of the scheduler that was current
+ * when the descriptor was registered (or a plain std::condition_variable
+ * outside of a scheduler), so in a coroutine based scheduler only the
+ * task is suspended, while the thread keeps running other tasks.
+ *
+ * Registered descriptors are put in non-blocking mode. They should only
+ * be read and written through the reactor while registered.
+ *
+ * The reactor is not available on every platform; where it's not, the
+ * constructor throws ostd::reactor_error with `ENOSYS`.
+ */
+struct OSTD_EXPORT reactor {
+    /** @brief Creates the reactor and starts its thread.
+     *
+     * @throws ostd::reactor_error on failure.
+     */
+    reactor();
+
+    /** @brief Stops the reactor thread.
+     *
+     * No task may be waiting on the reactor at this point.
+     */
+    ~reactor();
+
+    reactor(reactor const &) = delete;
+    reactor(reactor &&) = delete;
+    reactor &operator=(reactor const &) = delete;
+    reactor &operator=(reactor &&) = delete;
+
+    /** @brief Registers a file descriptor with the reactor.
+     *
+     * Puts the descriptor in non-blocking mode and starts watching it.
+     * Regular files are always ready, so registering them is pointless
+     * (and may fail, depending on the platform).
+     *
+     * @throws ostd::reactor_error on failure.
+     *
+     * @see remove(int)
+     */
+    void add(int fd);
+
+    /** @brief Registers the descriptor of a file stream.
+     *
+     * The stream is flushed first. Afterwards, reads through the stream
+     * should be done with read(file_stream &, void *, std::size_t) and
+     * writes with write(file_stream &, void const *, std::size_t).
+     *
+     * @throws ostd::reactor_error on failure.
+     */
+    void add(file_stream &f);
+
+    /** @brief Stops watching a file descriptor.
+     *
+     * The descriptor is put back in blocking mode. No task may be waiting
+     * on it at this point. Unregistered descriptors are ignored.
+     */
+    void remove(int fd) noexcept;
+
+    /** @brief Stops watching the descriptor of a file stream. */
+    void remove(file_stream &f) noexcept;
+
+    /** @brief Waits until a registered descriptor becomes readable.
+     *
+     * The wait may end spuriously, so the read should be attempted and
+     * the wait repeated if it would still block.
+     *
+     * @throws ostd::reactor_error if the descriptor is not registered.
+     */
+    void wait_readable(int fd);
+
+    /** @brief Waits until a registered descriptor becomes writable.
+     *
+     * Like wait_readable().
+     *
+     * @throws ostd::reactor_error if the descriptor is not registered.
+     */
+    void wait_writable(int fd);
+
+    /** @brief Reads at most `count` bytes from a registered descriptor.
+     *
+     * Waits until at least something can be read and then reads as much
+     * as is available, up to `count` bytes.
+     *
+     * @returns The number of bytes read, zero on end of file.
+     *
+     * @throws ostd::reactor_error on failure.
+     */
+    std::size_t read(int fd, void *buf, std::size_t count);
+
+    /** @brief Writes `count` bytes into a registered descriptor.
+     *
+     * Waits for the descriptor to become writable as many times as it
+     * takes to write everything.
+     *
+     * @throws ostd::reactor_error on failure.
+     */
+    void write(int fd, void const *buf, std::size_t count);
+
+    /** @brief Reads at most `count` bytes from a registered file stream.
+     *
+     * Unlike read(int, void *, std::size_t), this goes through the stream
+     * buffer and behaves like ostd::file_stream::read_bytes(), i.e. it
+     * only returns less than `count` on end of file.
+     *
+     * @returns The number of bytes read.
+     *
+     * @throws ostd::stream_error with EIO on failure.
+     * @throws ostd::reactor_error if the stream is not registered.
+     */
+    std::size_t read(file_stream &f, void *buf, std::size_t count);
+
+    /** @brief Writes `count` bytes into a registered file stream.
+     *
+     * The data is written directly into the descriptor, as the stream
+     * buffer cannot survive a write that would block.
+     *
+     * @throws ostd::stream_error with EIO on failure.
+     */
+    void write(file_stream &f, void const *buf, std::size_t count);
+
+private:
+    struct impl;
+    std::unique_ptr<impl> p_impl;
+};
+
+#ifdef OSTD_BUILD_TESTS
+#ifdef OSTD_PLATFORM_LINUX
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    /* way more than fits in a pipe, so both sides have to wait */
+    std::vector<unsigned char> payload(1 << 20);
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<unsigned char>(i * 7 + (i >> 11));
+    }
+    auto test = [&payload](auto &&sched) {
+        reactor r;
+        return sched.start([&r, &payload]() {
+            int fds[2];
+            if (pipe(fds) < 0) {
+                return false;
+            }
+            r.add(fds[0]);
+            r.add(fds[1]);
+            auto wt = spawn([&r, &payload, wfd = fds[1]]() {
+                std::size_t off = 0;
+                while (off < payload.size()) {
+                    auto n = std::min(payload.size() - off, std::size_t(5000));
+                    r.write(wfd, &payload[off], n);
+                    off += n;
+                    ostd::yield();
+                }
+                r.remove(wfd);
+                ::close(wfd);
+            });
+            auto rt = spawn([&r, rfd = fds[0]]() {
+                std::vector<unsigned char> ret;
+                unsigned char buf[3000];
+                while (std::size_t n = r.read(rfd, buf, sizeof(buf))) {
+                    ret.insert(ret.end(), buf, buf + n);
+                }
+                /* end of file stays that way */
+                if (r.read(rfd, buf, sizeof(buf))) {
+                    ret.clear();
+                }
+                return ret;
+            });
+            wt.get();
+            bool ok = (rt.get() == payload);
+            r.remove(fds[0]);
+            /* not registered anymore */
+            try {
+                r.wait_readable(fds[0]);
+                ok = false;
+            } catch (reactor_error const &e) {
+                ok = ok && (e.code() == std::errc::bad_file_descriptor);
+            }
+            ::close(fds[0]);
+            return ok;
+        });
+    };
+    fail_if_not(test(simple_coroutine_scheduler{}));
+    fail_if_not(test(coroutine_scheduler{2}));
+}
+#else
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    bool thrown = false;
+    try {
+        reactor r;
+    } catch (reactor_error const &e) {
+        thrown = (e.code() == std::errc::function_not_supported);
+    }
+    fail_if_not(thrown);
+}
+#endif
+#endif
+
+/** @} */
+
+} /* namespace ostd */
+
+#undef OSTD_TEST_MODULE
+
+#endif
+
+/** @} */
@@ -0,0 +1,286 @@
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @file sched_stats.hh
+ *
+ * @brief Statistics of the schedulers and the thread pool.
+ *
+ * The schedulers of the concurrency module as well as ostd::thread_pool
+ * can count what they do, so that pools can be sized and stalls found.
+ * The counting is only compiled in when `OSTD_USE_SCHED_STATS` is defined;
+ * otherwise the statistics only contain the queue depth and the counting
+ * costs nothing.
+ *
+ * Like `OSTD_USE_VALGRIND`, the macro changes the layout of the types, so
+ * it has to be defined the same way for the library and all code using it.
+ *
+ * @copyright See COPYING.md in the project tree for further information.
+ */
+
+#ifndef OSTD_SCHED_STATS_HH
+#define OSTD_SCHED_STATS_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <utility>
+
+#include <ostd/platform.hh>
+#include <ostd/context_stack.hh>
+
+namespace ostd {
+
+/** @addtogroup Concurrency
+ * @{
+ */
+
+/** @brief Whether the statistics are compiled in.
+ *
+ * True when `OSTD_USE_SCHED_STATS` is defined.
+ */
+#ifdef OSTD_USE_SCHED_STATS
+inline constexpr bool sched_stats_enabled = true;
+#else
+inline constexpr bool sched_stats_enabled = false;
+#endif
+
+/** @brief A histogram of durations with power of two buckets.
+ *
+ * The first bucket counts durations under a nanosecond, bucket `i` then
+ * counts durations of at least `2^(i-1)` and under `2^i` nanoseconds.
+ * The last bucket counts everything longer, too.
+ */
+struct sched_histogram {
+    /** @brief The number of buckets. */
+    static constexpr std::size_t BUCKETS = 40;
+
+    /** @brief The counts of the buckets. */
+    std::uint64_t counts[BUCKETS] = {};
+
+    /** @brief Gets the number of durations counted. */
+    std::uint64_t total() const noexcept {
+        std::uint64_t ret = 0;
+        for (auto c: counts) {
+            ret += c;
+        }
+        return ret;
+    }
+
+    /** @brief Gets an upper bound of the given quantile.
+     *
+     * For example, `quantile(0.99)` is a duration which at least 99% of
+     * the counted durations are shorter than, exact up to a factor of two.
+     * An empty histogram gives zero.
+     */
+    std::chrono::nanoseconds quantile(double q) const noexcept {
+        std::uint64_t n = total();
+        if (!n) {
+            return std::chrono::nanoseconds{0};
+        }
+        auto want = std::uint64_t(q * double(n));
+        std::uint64_t seen = 0;
+        std::size_t i = 0;
+        for (; i < (BUCKETS - 1); ++i) {
+            seen += counts[i];
+            if (seen > want) {
+                break;
+            }
+        }
+        return std::chrono::nanoseconds{std::int64_t(1) << i};
+    }
+};
+
+/** @brief A snapshot of the statistics of a scheduler or thread pool.
+ *
+ * Returned from the `stats()` method of ostd::thread_pool and the
+ * coroutine schedulers. The counters are totals since the start; the
+ * snapshot is not atomic as a whole, so they may be slightly out of
+ * step with each other.
+ */
+struct sched_stats {
+    /** @brief The number of tasks that are queued to run. */
+    std::size_t queued = 0;
+    /** @brief The number of task stacks in use. */
+    std::size_t stacks = 0;
+    /** @brief The number of tasks spawned. */
+    std::uint64_t spawned = 0;
+    /** @brief The number of tasks that have finished. */
+    std::uint64_t completed = 0;
+    /** @brief The number of times a task was switched to. */
+    std::uint64_t switches = 0;
+    /** @brief The number of tasks taken from another worker's queue. */
+    std::uint64_t steals = 0;
+    /** @brief How long a contended scheduler lock was waited for. */
+    sched_histogram lock_wait{};
+    /** @brief How long tasks ran before finishing or switching out. */
+    sched_histogram run_time{};
+};
+
+namespace detail {
+#ifdef OSTD_USE_SCHED_STATS
+    /* counters are written with relaxed atomics, mostly by a single
+     * thread each; the schedulers keep a set per worker where they can
+     */
+    struct sched_counters {
+        using time_point = std::chrono::steady_clock::time_point;
+
+        template<typename SA>
+        struct stack_allocator {
+            stack_context allocate() {
+                auto ret = p_alloc.allocate();
+                p_stats->add(p_stats->p_stacks, 1);
+                return ret;
+            }
+
+            void deallocate(stack_context &st) noexcept {
+                p_stats->add(p_stats->p_stacks, -1);
+                p_alloc.deallocate(st);
+            }
+
+            SA p_alloc;
+            sched_counters *p_stats;
+        };
+
+        static time_point now() noexcept {
+            return std::chrono::steady_clock::now();
+        }
+
+        void spawned(std::size_t n = 1) noexcept {
+            add(p_spawned, n);
+        }
+
+        void completed() noexcept {
+            add(p_completed, 1);
+        }
+
+        void switched() noexcept {
+            add(p_switches, 1);
+        }
+
+        void stolen() noexcept {
+            add(p_steals, 1);
+        }
+
+        void stack_taken(std::int64_t n) noexcept {
+            add(p_stacks, n);
+        }
+
+        void ran(time_point start) noexcept {
+            record(p_run, now() - start);
+        }
+
+        std::unique_lock<std::mutex> lock(std::mutex &mtx) {
+            std::unique_lock<std::mutex> l{mtx, std::try_to_lock};
+            if (!l.owns_lock()) {
+                auto start = now();
+                l.lock();
+                record(p_lock, now() - start);
+            }
+            return l;
+        }
+
+        template<typename SA>
+        stack_allocator<SA> stacks(SA sa) noexcept {
+            return stack_allocator<SA>{std::move(sa), this};
+        }
+
+        void merge(sched_counters const &o) noexcept {
+            sched_stats st;
+            o.get(st);
+            add(p_spawned, st.spawned);
+            add(p_completed, st.completed);
+            add(p_switches, st.switches);
+            add(p_steals, st.steals);
+            add(p_stacks, o.p_stacks.load(std::memory_order_relaxed));
+            for (std::size_t i = 0; i < sched_histogram::BUCKETS; ++i) {
+                add(p_lock[i], st.lock_wait.counts[i]);
+                add(p_run[i], st.run_time.counts[i]);
+            }
+        }
+
+        /* adds up, so that the counters of all workers can be summed */
+        void get(sched_stats &st) const noexcept {
+            auto ld = [](auto &v) {
+                return v.load(std::memory_order_relaxed);
+            };
+            st.spawned += ld(p_spawned);
+            st.completed += ld(p_completed);
+            st.switches += ld(p_switches);
+            st.steals += ld(p_steals);
+            /* a stack may be taken on one worker and given back on another,
+             * so only the sum makes sense; it wraps around back to positive
+             */
+            st.stacks += std::size_t(ld(p_stacks));
+            for (std::size_t i = 0; i < sched_histogram::BUCKETS; ++i) {
+                st.lock_wait.counts[i] += ld(p_lock[i]);
+                st.run_time.counts[i] += ld(p_run[i]);
+            }
+        }
+
+    private:
+        template<typename T, typename U>
+        static void add(std::atomic<T> &v, U n) noexcept {
+            v.fetch_add(T(n), std::memory_order_relaxed);
+        }
+
+        static void record(
+            std::atomic<std::uint64_t> *h, std::chrono::nanoseconds d
+        ) noexcept {
+            auto ns = std::uint64_t(d.count() > 0 ? d.count() : 0);
+            std::size_t b = 0;
+            while (ns && (b < (sched_histogram::BUCKETS - 1))) {
+                ns >>= 1;
+                ++b;
+            }
+            add(h[b], 1);
+        }
+
+        std::atomic<std::uint64_t> p_spawned{0};
+        std::atomic<std::uint64_t> p_completed{0};
+        std::atomic<std::uint64_t> p_switches{0};
+        std::atomic<std::uint64_t> p_steals{0};
+        std::atomic<std::int64_t> p_stacks{0};
+        std::atomic<std::uint64_t> p_lock[sched_histogram::BUCKETS] = {};
+        std::atomic<std::uint64_t> p_run[sched_histogram::BUCKETS] = {};
+    };
+#else
+    /* everything compiles down to nothing */
+    struct sched_counters {
+        struct time_point {};
+
+        static time_point now() noexcept {
+            return time_point{};
+        }
+
+        void spawned(std::size_t = 1) noexcept {}
+        void completed() noexcept {}
+        void switched() noexcept {}
+        void stolen() noexcept {}
+        void stack_taken(std::int64_t) noexcept {}
+        void ran(time_point) noexcept {}
+
+        std::unique_lock<std::mutex> lock(std::mutex &mtx) {
+            return std::unique_lock<std::mutex>{mtx};
+        }
+
+        template<typename SA>
+        SA stacks(SA sa) noexcept {
+            return sa;
+        }
+
+        void merge(sched_counters const &) noexcept {}
+        void get(sched_stats &) const noexcept {}
+    };
+#endif
+} /* namespace detail */
+
+/** @} */
+
+} /* namespace ostd */
+
+#endif
+
+/** @} */
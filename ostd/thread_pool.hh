@@ -7,7 +7,9 @@
  * @brief A pool of threads with workers.
  *
  * This file implements a regular thread pool with worker threads. It does
- * not do any elaborate stuff with coroutines or task scheduling.
+ * not do any elaborate stuff with coroutines or task scheduling. Workers
+ * can either share a single queue or use per-worker queues with stealing,
+ * and tasks can be queued with different priorities.
  *
  * @copyright See COPYING.md in the project tree for further information.
  */
@@ -16,17 +18,30 @@
 #define OSTD_THREAD_POOL_HH
 
 #include <cstddef>
+#include <cstdint>
 #include <type_traits>
+#include <algorithm>
 #include <functional>
 #include <utility>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <memory>
+#include <optional>
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <future>
 #include <mutex>
 #include <condition_variable>
 
+#include <ostd/unit_test.hh>
+#include <ostd/platform.hh>
+#include <ostd/affinity.hh>
+#include <ostd/sched_stats.hh>
+
+#define OSTD_TEST_MODULE libostd_thread_pool
+
 namespace ostd {
 
 /** @addtogroup Concurrency
@@ -34,7 +49,7 @@ namespace ostd {
  */
 
 namespace detail {
-    struct tpool_func_base {
+    struct OSTD_EXPORT tpool_func_base {
         tpool_func_base() {}
         virtual ~tpool_func_base();
         virtual void clone(tpool_func_base *func) = 0;
@@ -74,7 +89,10 @@ namespace detail {
 
         template<typename F>
         tpool_func(F &&func) {
-            if (sizeof(tpool_func_impl<F>) <= sizeof(p_buf)) {
+            if constexpr(
+                (sizeof(tpool_func_impl<F>) <= sizeof(p_buf)) &&
+                (alignof(tpool_func_impl<F>) <= alignof(decltype(p_buf)))
+            ) {
                 p_func = ::new(reinterpret_cast<void *>(&p_buf))
                     tpool_func_impl<F>{std::move(func)};
             } else {
@@ -100,31 +118,182 @@ namespace detail {
         > p_buf;
         tpool_func_base *p_func;
     };
+
+    struct tpool_worker {
+        tpool_worker(void const *pool, std::size_t idx):
+            p_pool(pool), p_seed(std::uint32_t(idx) * 2654435761U + 1)
+        {}
+
+        /* xorshift, only used to pick steal victims */
+        std::uint32_t next_victim(std::size_t n) noexcept {
+            std::uint32_t x = p_seed;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            p_seed = x;
+            return x % n;
+        }
+
+        std::mutex p_lock;
+        std::deque<tpool_func> p_tasks;
+        std::thread p_thread;
+        void const *p_pool;
+        std::uint32_t p_seed;
+        std::size_t p_local = 0;
+        bool p_live = false;
+        sched_counters p_stats;
+    };
+
+    OSTD_EXPORT extern thread_local tpool_worker *current_tpool_worker;
 }
 
+/** @brief The queueing strategy used by ostd::thread_pool.
+ *
+ * The shared mode is the simplest; every worker takes tasks from a single
+ * FIFO queue. This is fair and has the least overhead with few workers or
+ * long running tasks, but the queue lock becomes a bottleneck once tasks
+ * are short and there are many workers.
+ *
+ * In the work stealing mode, every worker has its own queue. Tasks queued
+ * from within a worker go to that worker's queue and are taken in LIFO
+ * order for locality, tasks queued from outside the pool go into a shared
+ * queue. Once a worker runs out of both, it steals the oldest task from
+ * the queue of a randomly picked other worker.
+ */
+enum class thread_pool_mode {
+    SHARED = 0,   ///< All workers share a single FIFO queue.
+    WORK_STEALING ///< Per-worker queues with randomized stealing.
+};
+
+/** @brief The priority of a task queued in ostd::thread_pool.
+ *
+ * Every priority has its own FIFO lane in the shared queue and workers
+ * take from the highest non-empty lane first. To keep the lower lanes
+ * from starving under a steady stream of more important work, a lane
+ * that has been passed over thread_pool::AGING times while not empty
+ * gets its next task taken first.
+ *
+ * In the work stealing mode, normal priority tasks queued from within
+ * a worker still go to its own queue; the other priorities always go
+ * through the shared lanes, and high priority tasks are taken before
+ * the worker's own.
+ */
+enum class thread_pool_priority {
+    HIGH = 0, ///< Latency sensitive work, such as control tasks.
+    NORMAL,   ///< The default.
+    LOW       ///< Bulk work that may wait.
+};
+
+/** @brief The worker limits of an elastic ostd::thread_pool.
+ *
+ * An elastic pool keeps at least `min` workers around and grows up to
+ * `max` of them on demand. A new worker is started when a task is queued
+ * while at least `queue_depth` more tasks are queued than there are idle
+ * workers, or while nobody is idle and no worker has taken a task for
+ * `max_wait`. Workers beyond `min` exit once they have been idle for
+ * `idle_timeout`.
+ *
+ * The conditions are checked whenever a task is queued; there is no
+ * monitoring thread.
+ */
+struct thread_pool_limits {
+    /** @brief The number of workers that are never retired. */
+    std::size_t min = 1;
+    /** @brief The maximum number of workers, at least one. */
+    std::size_t max = std::thread::hardware_concurrency();
+    /** @brief The queued tasks per missing idle worker to grow at. */
+    std::size_t queue_depth = 1;
+    /** @brief How long the queue may go without progress to grow. */
+    std::chrono::milliseconds max_wait{10};
+    /** @brief How long a worker beyond `min` may stay idle. */
+    std::chrono::milliseconds idle_timeout{10000};
+};
+
 /** @brief A thread pool.
  *
  * A simple thread pool that lets you start a specified number of threads
  * and queue tasks onto them. No elaborate scheduling is performed, tasks
  * are called on threads as they become available and are assumed completed
  * once they return.
+ *
+ * The way tasks are distributed between the threads is decided by the
+ * ostd::thread_pool_mode given to start(). Tasks can be given one of the
+ * ostd::thread_pool_priority levels; some of the threads can be reserved
+ * for the high priority ones, so that their latency stays bounded even
+ * when all the other threads are busy with long running work.
+ *
+ * The number of workers can either be fixed or elastic, within the given
+ * ostd::thread_pool_limits; either way it can be changed with resize()
+ * while the pool is running. The reserved threads are always fixed.
+ *
+ * The threads can be pinned to CPUs and named, see set_affinity().
  */
 struct thread_pool {
+    /** @brief How many times a non-empty lane may be passed over.
+     *
+     * See ostd::thread_pool_priority.
+     */
+    static constexpr std::size_t AGING = 8;
+
+    /** @brief Sets how the threads of the pool are placed and named.
+     *
+     * Applies to the threads started afterwards, so it's normally called
+     * before start(). The reserved threads come first in the placement
+     * order, followed by the workers; in an elastic pool, a worker keeps
+     * its index and thus its CPU when it is restarted.
+     *
+     * @throws std::system_error if any of the CPUs is not available.
+     */
+    void set_affinity(thread_affinity const &aff) {
+        detail::thread_placer pl{aff};
+        std::lock_guard<std::mutex> l{p_lock};
+        p_placer = std::move(pl);
+    }
+
     /** @brief Starts the thread pool.
      *
      * Creates the threads and marks the pool as running. The number of
      * threads defaults to the number of hardware threads in your system.
+     * The queueing mode defaults to ostd::thread_pool_mode::SHARED.
+     *
+     * Out of the threads, `reserved` only ever run high priority tasks.
+     * At least one thread is always left for the other priorities, so
+     * the number is capped at `size - 1`.
+     *
+     * A `size` of zero starts no threads at all, so queued tasks never
+     * run until the pool is given workers with resize().
      *
      * @param[in] size The number of threads to use.
+     * @param[in] mode The queueing mode to use.
+     * @param[in] reserved The number of threads for high priority tasks.
      */
-    void start(std::size_t size = std::thread::hardware_concurrency()) {
-        p_running = true;
-        auto tf = [this]() {
-            thread_run();
-        };
-        for (std::size_t i = 0; i < size; ++i) {
-            p_thrs.push_back(std::thread{tf});
-        }
+    void start(
+        std::size_t size = std::thread::hardware_concurrency(),
+        thread_pool_mode mode = thread_pool_mode::SHARED,
+        std::size_t reserved = 0
+    ) {
+        reserved = size ? std::min(reserved, size - 1) : 0;
+        thread_pool_limits lim;
+        lim.min = lim.max = size - reserved;
+        start_pool(lim, lim.max, mode, reserved);
+    }
+
+    /** @brief Starts an elastic thread pool.
+     *
+     * Like start(std::size_t, thread_pool_mode, std::size_t), but the
+     * number of workers varies within the given limits, starting with
+     * the minimum. The `reserved` threads come on top of those.
+     *
+     * @param[in] lim The worker limits.
+     * @param[in] mode The queueing mode to use.
+     * @param[in] reserved The number of threads for high priority tasks.
+     */
+    void start(
+        thread_pool_limits const &lim,
+        thread_pool_mode mode = thread_pool_mode::SHARED,
+        std::size_t reserved = 0
+    ) {
+        start_pool(lim, std::max(lim.max, std::size_t(1)), mode, reserved);
     }
 
     /** @brief Calls destroy(). */
@@ -147,12 +316,76 @@ struct thread_pool {
             }
             p_running = false;
         }
+        /* no workers are started once the pool is stopped, so the list
+         * stays as it is; retired workers have been joined or exited
+         */
         p_cond.notify_all();
+        p_hcond.notify_all();
+        auto join = [this](std::thread &tid) {
+            if (tid.joinable()) {
+                tid.join();
+                p_cond.notify_all();
+                p_hcond.notify_all();
+            }
+        };
         for (auto &tid: p_thrs) {
-            tid.join();
-            p_cond.notify_all();
+            join(tid);
+        }
+        for (auto &w: p_workers) {
+            join(w->p_thread);
+        }
+        for (auto &w: p_workers) {
+            p_stats.merge(w->p_stats);
         }
         p_thrs.clear();
+        p_nslots = 0;
+        p_slots = nullptr;
+        p_slotbufs.clear();
+        p_slotcap = 0;
+        p_workers.clear();
+        /* everybody has been joined, so none of the threads are left */
+        p_nlive = 0;
+        p_reserved = 0;
+    }
+
+    /** @brief Changes the worker limits of a running pool.
+     *
+     * Workers are started right away until there are at least `min`.
+     * If there are more than `max`, the surplus ones exit as soon as
+     * they are done with the task they are running (in the work stealing
+     * mode, once their own queue is empty). Setting both to the same
+     * value makes the number of workers fixed; the reserved threads are
+     * not counted and stay as they are.
+     *
+     * The `max` is at least one and `min` is capped at `max`.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     * @throws std::system_error if a thread could not be started.
+     */
+    void resize(std::size_t min, std::size_t max) {
+        {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (!p_running) {
+                throw std::runtime_error{"resize on stopped thread_pool"};
+            }
+            set_limits(min, std::max(max, std::size_t(1)));
+            while (p_nlive < p_min) {
+                spawn_worker();
+            }
+        }
+        /* idle workers re-evaluate whether they should stay */
+        p_cond.notify_all();
+    }
+
+    /** @brief Sets a fixed number of workers.
+     *
+     * Equivalent to `resize(size, size)`.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     * @throws std::system_error if a thread could not be started.
+     */
+    void resize(std::size_t size) {
+        resize(size, size);
     }
 
     /** @brief Queues a new task for execution.
@@ -164,6 +397,9 @@ struct thread_pool {
      *
      * The function's argument types and the provided arguments must match.
      *
+     * In the work stealing mode, tasks pushed from within a task running
+     * on this pool go to the current worker's own queue.
+     *
      * @param[in] func The function to queue.
      * @param[in] args A parameter pack matching the function's arguments.
      *
@@ -174,6 +410,22 @@ struct thread_pool {
     template<typename F, typename ...A>
     auto push(F &&func, A &&...args) ->
         std::future<std::result_of_t<F(A...)>>
+    {
+        return push(
+            thread_pool_priority::NORMAL,
+            std::forward<F>(func), std::forward<A>(args)...
+        );
+    }
+
+    /** @brief Queues a new task for execution with the given priority.
+     *
+     * Like push(F &&, A &&...), which uses the normal priority.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     */
+    template<typename F, typename ...A>
+    auto push(thread_pool_priority prio, F &&func, A &&...args) ->
+        std::future<std::result_of_t<F(A...)>>
     {
         using R = std::result_of_t<F(A...)>;
         std::packaged_task<R()> t;
@@ -185,50 +437,662 @@ struct thread_pool {
             };
         }
         auto ret = t.get_future();
+        enqueue(detail::tpool_func{std::move(t)}, prio);
+        return ret;
+    }
+
+    /** @brief Queues a new task for execution without a future.
+     *
+     * Like push(), but nothing is attached to the task, so there is no
+     * shared state to allocate and the result of the function is simply
+     * discarded. Use this for fire-and-forget work.
+     *
+     * As there is nothing to propagate them to, the function must not
+     * let any exceptions escape; if it does, `std::terminate` is called.
+     *
+     * @param[in] func The function to queue.
+     * @param[in] args A parameter pack matching the function's arguments.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     */
+    template<typename F, typename ...A>
+    void post(F &&func, A &&...args) {
+        enqueue(
+            make_func(std::forward<F>(func), std::forward<A>(args)...),
+            thread_pool_priority::NORMAL
+        );
+    }
+
+    /** @brief Queues a new task without a future with the given priority.
+     *
+     * Like post(F &&, A &&...), which uses the normal priority.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     */
+    template<typename F, typename ...A>
+    void post(thread_pool_priority prio, F &&func, A &&...args) {
+        enqueue(
+            make_func(std::forward<F>(func), std::forward<A>(args)...), prio
+        );
+    }
+
+    /** @brief Queues every function in the given range without futures.
+     *
+     * Every element of the range is a function that is queued as if
+     * by post(). The elements are copied, unless the range's reference
+     * type is an rvalue reference, in which case they are moved.
+     *
+     * The whole range is queued with a single lock acquisition and the
+     * workers are woken up once afterwards, so this is considerably cheaper
+     * than posting every function separately when fanning out many tasks.
+     *
+     * The range must be at least ostd::input_range_tag.
+     *
+     * @param[in] range The range of functions.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     */
+    template<typename InputRange>
+    void push_bulk(InputRange range) {
+        push_bulk(thread_pool_priority::NORMAL, std::move(range));
+    }
+
+    /** @brief Queues every function in the range with the given priority.
+     *
+     * Like push_bulk(InputRange), which uses the normal priority.
+     *
+     * @throws std::runtime_error if the pool is not running.
+     */
+    template<typename InputRange>
+    void push_bulk(thread_pool_priority prio, InputRange range) {
+        std::vector<detail::tpool_func> funcs;
+        for (; !range.empty(); range.pop_front()) {
+            funcs.push_back(make_func(
+                std::forward<decltype(range.front())>(range.front())
+            ));
+        }
+        enqueue_bulk(funcs, prio);
+    }
+
+    /** @brief Gets the number of threads in the pool.
+     *
+     * This includes the reserved threads. In an elastic pool, it is
+     * the number of workers at the time of the call.
+     */
+    unsigned int threads() const noexcept {
+        return unsigned(p_reserved + p_nlive);
+    }
+
+    /** @brief Gets the number of threads reserved for high priority. */
+    unsigned int reserved() const noexcept {
+        return p_reserved;
+    }
+
+    /** @brief Gets the queueing mode the pool was started with. */
+    thread_pool_mode mode() const noexcept {
+        return p_mode;
+    }
+
+    /** @brief Gets a snapshot of the statistics of the pool.
+     *
+     * See ostd::sched_stats. Tasks of a thread pool always run to the end,
+     * so there are no switches and no stacks. Only the number of queued
+     * tasks is available unless `OSTD_USE_SCHED_STATS` is defined.
+     */
+    sched_stats stats() const noexcept {
+        sched_stats ret;
+        ret.queued = p_pending.load();
+        p_stats.get(ret);
+        std::size_t nw = p_nslots.load(std::memory_order_acquire);
+        auto **slots = p_slots.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < nw; ++i) {
+            slots[i]->p_stats.get(ret);
+        }
+        return ret;
+    }
+
+private:
+    using clock_rep = std::chrono::steady_clock::rep;
+
+    static clock_rep clock_now() noexcept {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    static void run_task(
+        detail::tpool_func &func, detail::sched_counters &st
+    ) {
+        auto start = st.now();
+        func();
+        st.ran(start);
+        st.completed();
+    }
+
+    template<typename F, typename ...A>
+    static detail::tpool_func make_func(F &&func, A &&...args) {
+        if constexpr(sizeof...(A) == 0) {
+            return detail::tpool_func{std::decay_t<F>(std::forward<F>(func))};
+        } else {
+            return detail::tpool_func{
+                std::bind(std::forward<F>(func), std::forward<A>(args)...)
+            };
+        }
+    }
+
+    /* the fixed size start may ask for no workers at all, the others
+     * have the maximum clamped to one
+     */
+    void start_pool(
+        thread_pool_limits const &lim, std::size_t max, thread_pool_mode mode,
+        std::size_t reserved
+    ) {
+        p_mode = mode;
+        p_reserved = reserved;
+        p_depth = std::max(lim.queue_depth, std::size_t(1));
+        p_max_wait = lim.max_wait;
+        p_idle_timeout = lim.idle_timeout;
+        p_last_take = clock_now();
+        p_running = true;
+        std::lock_guard<std::mutex> l{p_lock};
+        for (std::size_t i = 0; i < p_reserved; ++i) {
+            p_thrs.push_back(std::thread{[this, i, pl = p_placer]() {
+                pl.apply(i);
+                thread_run_reserved();
+            }});
+        }
+        set_limits(lim.min, max);
+        while (p_nlive < p_min) {
+            spawn_worker();
+        }
+    }
+
+    /* called with the lock held */
+    void set_limits(std::size_t min, std::size_t max) {
+        p_max = max;
+        p_min = std::min(min, p_max.load());
+        p_elastic = (p_min < p_max);
+    }
+
+    /* called with the lock held; retired workers are reused, joining
+     * their old thread first, which has released the lock for good by
+     * the time we could take it
+     */
+    void spawn_worker() {
+        std::size_t idx = 0;
+        while ((idx < p_workers.size()) && p_workers[idx]->p_live) {
+            ++idx;
+        }
+        detail::tpool_worker *w;
+        if (idx < p_workers.size()) {
+            w = p_workers[idx].get();
+        } else {
+            w = add_worker();
+        }
+        idx += p_reserved;
+        if (w->p_thread.joinable()) {
+            w->p_thread.join();
+        }
+        w->p_live = true;
+        w->p_local = 0;
+        ++p_nlive;
+        try {
+            if (p_mode == thread_pool_mode::WORK_STEALING) {
+                w->p_thread = std::thread{[this, w, idx, pl = p_placer]() {
+                    pl.apply(idx);
+                    thread_run_ws(*w);
+                }};
+            } else {
+                w->p_thread = std::thread{[this, w, idx, pl = p_placer]() {
+                    pl.apply(idx);
+                    thread_run(*w);
+                }};
+            }
+        } catch (...) {
+            w->p_live = false;
+            --p_nlive;
+            throw;
+        }
+    }
+
+    /* called with the lock held; stealing workers read the slots without
+     * it, so a full buffer is replaced rather than reallocated, keeping
+     * the old one alive for whoever may still be looking at it
+     */
+    detail::tpool_worker *add_worker() {
+        std::size_t n = p_workers.size();
+        p_workers.emplace_back(new detail::tpool_worker{this, n});
+        auto *w = p_workers.back().get();
+        if (n == p_slotcap) {
+            std::size_t cap = n ? (n * 2) : 8;
+            std::unique_ptr<detail::tpool_worker *[]> buf{
+                new detail::tpool_worker *[cap]
+            };
+            std::copy(p_slots.load(), p_slots.load() + n, buf.get());
+            p_slots.store(buf.get(), std::memory_order_release);
+            p_slotbufs.push_back(std::move(buf));
+            p_slotcap = cap;
+        }
+        p_slots.load()[n] = w;
+        p_nslots.store(n + 1, std::memory_order_release);
+        return w;
+    }
+
+    /* called with the lock held; the thread must not touch the worker
+     * nor the pool after the lock is released
+     */
+    void retire(detail::tpool_worker &w) {
+        w.p_live = false;
+        --p_nlive;
+    }
+
+    void touch() noexcept {
+        if (p_elastic.load(std::memory_order_relaxed)) {
+            p_last_take.store(clock_now(), std::memory_order_relaxed);
+        }
+    }
+
+    /* called after queuing, without any locks held */
+    void maybe_grow() {
+        if (p_nlive.load() >= p_max.load()) {
+            return;
+        }
+        std::size_t idle = p_idle.load();
+        bool grow = (p_pending.load() >= (idle + p_depth)) || !p_nlive;
+        if (!grow && !idle) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::duration{clock_now() - p_last_take}
+            );
+            grow = (wait >= p_max_wait);
+        }
+        if (!grow) {
+            return;
+        }
+        std::lock_guard<std::mutex> l{p_lock};
+        if (!p_running || (p_nlive >= p_max)) {
+            return;
+        }
+        try {
+            spawn_worker();
+        } catch (std::system_error const &) {
+            /* the task is queued already, leave it to the others */
+        }
+    }
+
+    bool local_queue(thread_pool_priority prio) const noexcept {
+        if (
+            (p_mode != thread_pool_mode::WORK_STEALING) ||
+            (prio != thread_pool_priority::NORMAL)
+        ) {
+            return false;
+        }
+        auto *w = detail::current_tpool_worker;
+        return w && (w->p_pool == this);
+    }
+
+    /* called with the lock held */
+    void push_lane(detail::tpool_func &&func, thread_pool_priority prio) {
+        p_lanes[std::size_t(prio)].push(std::move(func));
+        ++p_nshared;
+        if (prio == thread_pool_priority::HIGH) {
+            ++p_nhigh;
+        }
+    }
+
+    void notify_lane(thread_pool_priority prio, bool all) {
+        if (all) {
+            p_cond.notify_all();
+        } else {
+            p_cond.notify_one();
+        }
+        if (p_reserved && (prio == thread_pool_priority::HIGH)) {
+            if (all) {
+                p_hcond.notify_all();
+            } else {
+                p_hcond.notify_one();
+            }
+        }
+    }
+
+    void enqueue_bulk(
+        std::vector<detail::tpool_func> &funcs, thread_pool_priority prio
+    ) {
+        std::size_t n = funcs.size();
+        if (!n) {
+            return;
+        }
+        if (local_queue(prio)) {
+            auto *w = detail::current_tpool_worker;
+            if (!p_running) {
+                throw std::runtime_error{"push on stopped thread_pool"};
+            }
+            p_pending += n;
+            w->p_stats.spawned(n);
+            {
+                std::lock_guard<std::mutex> l{w->p_lock};
+                for (auto &f: funcs) {
+                    w->p_tasks.push_back(std::move(f));
+                }
+            }
+            if (p_idle > 0) {
+                { std::lock_guard<std::mutex> l{p_lock}; }
+                p_cond.notify_all();
+            }
+            maybe_grow();
+            return;
+        }
         {
-            std::lock_guard<std::mutex> l{p_lock};
+            auto l = p_stats.lock(p_lock);
+            if (!p_running) {
+                throw std::runtime_error{"push on stopped thread_pool"};
+            }
+            for (auto &f: funcs) {
+                push_lane(std::move(f), prio);
+            }
+            p_pending += n;
+            p_stats.spawned(n);
+        }
+        notify_lane(prio, n > 1);
+        maybe_grow();
+    }
+
+    void enqueue(detail::tpool_func &&func, thread_pool_priority prio) {
+        if (local_queue(prio)) {
+            auto *w = detail::current_tpool_worker;
             if (!p_running) {
                 throw std::runtime_error{"push on stopped thread_pool"};
             }
-            p_tasks.emplace(std::move(t));
+            /* count first, so that nobody goes to sleep while
+             * the task is not in any of the queues just yet
+             */
+            ++p_pending;
+            w->p_stats.spawned();
+            {
+                std::lock_guard<std::mutex> l{w->p_lock};
+                w->p_tasks.push_back(std::move(func));
+            }
+            wake_one();
+            maybe_grow();
+            return;
+        }
+        {
+            auto l = p_stats.lock(p_lock);
+            if (!p_running) {
+                throw std::runtime_error{"push on stopped thread_pool"};
+            }
+            push_lane(std::move(func), prio);
+            ++p_pending;
+            p_stats.spawned();
+        }
+        notify_lane(prio, false);
+        maybe_grow();
+    }
+
+    void wake_one() {
+        /* sleepers increment the idle count under the lock before they
+         * check the pending count, so either they see our task or we see
+         * them; taking the lock makes sure they are actually waiting
+         */
+        if (p_idle > 0) {
+            { std::lock_guard<std::mutex> l{p_lock}; }
+            p_cond.notify_one();
+        }
+    }
+
+    /* waits on the general condvar as an idle worker, with the lock
+     * held; returns true if the worker stayed idle for the whole timeout
+     */
+    template<typename P>
+    bool idle_wait(std::unique_lock<std::mutex> &l, P pred) {
+        bool ret = false;
+        ++p_idle;
+        while (pred()) {
+            if (p_nlive <= p_min) {
+                p_cond.wait(l);
+            } else if (
+                p_cond.wait_for(l, p_idle_timeout) == std::cv_status::timeout
+            ) {
+                ret = true;
+                break;
+            }
         }
-        p_cond.notify_one();
+        --p_idle;
         return ret;
     }
 
-    /** @brief Gets the number of threads in the pool. */
-    unsigned int threads() const noexcept {
-        return p_thrs.size();
+    /* takes from the highest lane, unless a lower one has been passed
+     * over too many times; called with the lock held
+     */
+    std::optional<detail::tpool_func> take_lane(bool high_only) {
+        std::optional<detail::tpool_func> ret;
+        std::size_t lane = 0;
+        while ((lane < NLANES) && p_lanes[lane].empty()) {
+            ++lane;
+        }
+        if ((lane == NLANES) || (high_only && lane)) {
+            return ret;
+        }
+        if (!high_only) {
+            for (std::size_t i = NLANES - 1; i > lane; --i) {
+                if (!p_lanes[i].empty() && (p_skips[i] >= AGING)) {
+                    lane = i;
+                    break;
+                }
+            }
+            for (std::size_t i = lane + 1; i < NLANES; ++i) {
+                if (!p_lanes[i].empty()) {
+                    ++p_skips[i];
+                }
+            }
+            p_skips[lane] = 0;
+        }
+        ret.emplace(std::move(p_lanes[lane].front()));
+        p_lanes[lane].pop();
+        --p_nshared;
+        if (!lane) {
+            --p_nhigh;
+        }
+        return ret;
     }
 
-private:
-    void thread_run() {
+    std::optional<detail::tpool_func> take_ws(detail::tpool_worker &w) {
+        std::optional<detail::tpool_func> ret;
+        /* high priority work goes before our own, and every now and then
+         * the rest of the shared lanes too, so that they don't starve
+         * while we keep feeding ourselves
+         */
+        if (p_nhigh.load() || (p_nshared.load() && (w.p_local >= AGING))) {
+            w.p_local = 0;
+            auto l = p_stats.lock(p_lock);
+            if (auto t = take_lane(false); t) {
+                return t;
+            }
+        }
+        /* own queue first, newest task as it's most likely still hot */
+        {
+            std::lock_guard<std::mutex> l{w.p_lock};
+            if (!w.p_tasks.empty()) {
+                ret.emplace(std::move(w.p_tasks.back()));
+                w.p_tasks.pop_back();
+                ++w.p_local;
+                return ret;
+            }
+        }
+        /* then whatever came from outside the pool */
+        {
+            auto l = p_stats.lock(p_lock);
+            if (auto t = take_lane(false); t) {
+                return t;
+            }
+        }
+        /* then steal the oldest task from somebody else; the count goes
+         * first, so the slots seen are at least as many
+         */
+        std::size_t nw = p_nslots.load(std::memory_order_acquire);
+        auto **slots = p_slots.load(std::memory_order_acquire);
+        std::size_t vi = w.next_victim(nw);
+        for (std::size_t i = 0; i < nw; ++i, vi = (vi + 1) % nw) {
+            auto &v = *slots[vi];
+            if (&v == &w) {
+                continue;
+            }
+            std::unique_lock<std::mutex> l{v.p_lock, std::try_to_lock};
+            if (!l.owns_lock() || v.p_tasks.empty()) {
+                continue;
+            }
+            ret.emplace(std::move(v.p_tasks.front()));
+            v.p_tasks.pop_front();
+            w.p_stats.stolen();
+            return ret;
+        }
+        return ret;
+    }
+
+    void thread_run_ws(detail::tpool_worker &w) {
+        detail::current_tpool_worker = &w;
+        bool expired = false;
         for (;;) {
-            std::unique_lock<std::mutex> l{p_lock};
-            while (p_running && p_tasks.empty()) {
-                p_cond.wait(l);
+            if (auto t = take_ws(w); t) {
+                --p_pending;
+                touch();
+                run_task(*t, w.p_stats);
+                expired = false;
+                if (p_nlive.load() <= p_max.load()) {
+                    continue;
+                }
+            }
+            /* nothing is queued to us unless we queue it ourselves, so
+             * our queue is empty whenever we are not running a task
+             */
+            auto l = p_stats.lock(p_lock);
+            bool surplus = (p_nlive > p_max);
+            if (surplus) {
+                std::lock_guard<std::mutex> wl{w.p_lock};
+                surplus = w.p_tasks.empty();
+            }
+            bool quit = surplus || (
+                expired && !p_pending && (p_nlive > p_min)
+            );
+            if (!quit) {
+                expired = idle_wait(l, [this]() {
+                    return p_running && !p_pending && (p_nlive <= p_max);
+                });
+                quit = !p_running && !p_pending;
             }
-            if (!p_running && p_tasks.empty()) {
+            if (quit) {
+                detail::current_tpool_worker = nullptr;
+                retire(w);
                 return;
             }
-            auto t{std::move(p_tasks.front())};
-            p_tasks.pop();
+        }
+    }
+
+    /* the shared mode */
+    void thread_run(detail::tpool_worker &w) {
+        bool expired = false;
+        auto l = p_stats.lock(p_lock);
+        while (p_nlive <= p_max) {
+            if (auto t = take_lane(false); t) {
+                --p_pending;
+                touch();
+                l.unlock();
+                run_task(*t, w.p_stats);
+                l = p_stats.lock(p_lock);
+                expired = false;
+                continue;
+            }
+            if (!p_running || (expired && (p_nlive > p_min))) {
+                break;
+            }
+            expired = idle_wait(l, [this]() {
+                return p_running && !p_nshared && (p_nlive <= p_max);
+            });
+        }
+        retire(w);
+    }
+
+    /* the reserved threads of either mode */
+    void thread_run_reserved() {
+        for (;;) {
+            auto l = p_stats.lock(p_lock);
+            auto t = take_lane(true);
+            if (!t) {
+                if (!p_running) {
+                    return;
+                }
+                p_hcond.wait(l);
+                continue;
+            }
+            --p_pending;
             l.unlock();
-            t();
+            run_task(*t, p_stats);
         }
     }
 
+    static constexpr std::size_t NLANES = 3;
+
     std::condition_variable p_cond;
+    std::condition_variable p_hcond;
     std::mutex p_lock;
     std::vector<std::thread> p_thrs;
-    std::queue<detail::tpool_func> p_tasks;
-    bool p_running = false;
+    std::vector<std::unique_ptr<detail::tpool_worker>> p_workers;
+    std::vector<std::unique_ptr<detail::tpool_worker *[]>> p_slotbufs;
+    detail::thread_placer p_placer;
+    detail::sched_counters p_stats;
+    std::atomic<detail::tpool_worker **> p_slots = nullptr;
+    std::atomic<std::size_t> p_nslots = 0;
+    std::size_t p_slotcap = 0;
+    std::queue<detail::tpool_func> p_lanes[NLANES];
+    std::size_t p_skips[NLANES] = {};
+    std::atomic<std::size_t> p_nshared = 0;
+    std::atomic<std::size_t> p_nhigh = 0;
+    std::atomic<std::size_t> p_pending = 0;
+    std::atomic<std::size_t> p_idle = 0;
+    std::atomic<std::size_t> p_nlive = 0;
+    std::atomic<std::size_t> p_max = 0;
+    std::size_t p_min = 0;
+    std::size_t p_depth = 1;
+    std::chrono::milliseconds p_max_wait{};
+    std::chrono::milliseconds p_idle_timeout{};
+    std::atomic<clock_rep> p_last_take = 0;
+    std::atomic<bool> p_elastic = false;
+    std::atomic<bool> p_running = false;
+    std::size_t p_reserved = 0;
+    thread_pool_mode p_mode = thread_pool_mode::SHARED;
 };
 
+#ifdef OSTD_BUILD_TESTS
+OSTD_UNIT_TEST {
+    using ostd::test::fail_if_not;
+    for (auto mode: {
+        thread_pool_mode::SHARED, thread_pool_mode::WORK_STEALING
+    }) {
+        thread_pool tp;
+        tp.start(4, mode, 1);
+        fail_if_not((tp.threads() == 4) && (tp.reserved() == 1));
+        auto f = tp.push([]() { return 42; });
+        fail_if_not(f.get() == 42);
+        tp.destroy();
+        fail_if_not((tp.threads() == 0) && (tp.reserved() == 0));
+        /* elastic, after having been stopped once */
+        thread_pool_limits lim;
+        lim.min = 1;
+        lim.max = 3;
+        tp.start(lim, mode, 2);
+        fail_if_not((tp.threads() == 3) && (tp.reserved() == 2));
+        tp.destroy();
+        fail_if_not((tp.threads() == 0) && (tp.reserved() == 0));
+        /* destroying again does nothing */
+        tp.destroy();
+        fail_if_not(tp.threads() == 0);
+    }
+}
+#endif
+
 /** @} */
 
 } /* namespace ostd */
 
+#undef OSTD_TEST_MODULE
+
 #endif
 
 /** @} */
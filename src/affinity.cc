@@ -0,0 +1,125 @@
+/* CPU topology and thread placement; decides between the implementations
+ * of the platform specific bits.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cerrno>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <system_error>
+
+#include "ostd/platform.hh"
+#include "ostd/affinity.hh"
+
+#if defined(OSTD_PLATFORM_LINUX)
+#  include "src/posix/affinity.cc"
+#else
+
+namespace ostd {
+
+/* no topology information for this platform yet */
+OSTD_EXPORT std::vector<cpu_info> cpu_topology() {
+    std::vector<cpu_info> ret;
+    unsigned int n = std::max(std::thread::hardware_concurrency(), 1U);
+    for (unsigned int i = 0; i < n; ++i) {
+        ret.push_back(cpu_info{i, i, 0, 0});
+    }
+    return ret;
+}
+
+namespace detail {
+    void thread_placer::apply(std::size_t) const noexcept {}
+} /* namespace detail */
+
+} /* namespace ostd */
+
+#endif
+
+namespace ostd {
+
+OSTD_EXPORT std::vector<unsigned int> thread_cpus(thread_affinity const &aff) {
+    auto topo = cpu_topology();
+    if (!aff.cpus.empty()) {
+        for (auto id: aff.cpus) {
+            auto it = std::find_if(topo.begin(), topo.end(), [id](auto &c) {
+                return c.id == id;
+            });
+            if (it == topo.end()) {
+                throw std::system_error{EINVAL, std::generic_category()};
+            }
+        }
+        topo.erase(std::remove_if(topo.begin(), topo.end(), [&aff](auto &c) {
+            return std::find(
+                aff.cpus.begin(), aff.cpus.end(), c.id
+            ) == aff.cpus.end();
+        }), topo.end());
+    }
+    std::vector<unsigned int> ret;
+    switch (aff.placement) {
+        case thread_placement::NONE:
+            return ret;
+        case thread_placement::PIN:
+            if (!aff.cpus.empty()) {
+                return aff.cpus;
+            }
+            for (auto &c: topo) {
+                ret.push_back(c.id);
+            }
+            return ret;
+        default:
+            break;
+    }
+    /* every domain lists the first hardware thread of each core, then
+     * the second one and so on, as siblings share most of the core
+     */
+    using dom_cpu = std::pair<std::size_t, unsigned int>;
+    std::map<unsigned int, std::vector<dom_cpu>> doms;
+    std::map<unsigned int, std::size_t> siblings;
+    for (auto &c: topo) {
+        doms[c.cache].emplace_back(siblings[c.core]++, c.id);
+    }
+    std::vector<std::vector<unsigned int>> order;
+    for (auto &d: doms) {
+        std::stable_sort(
+            d.second.begin(), d.second.end(), [](auto &a, auto &b) {
+                return a.first < b.first;
+            }
+        );
+        auto &v = order.emplace_back();
+        for (auto &p: d.second) {
+            v.push_back(p.second);
+        }
+    }
+    if (aff.placement == thread_placement::PACK) {
+        for (auto &v: order) {
+            ret.insert(ret.end(), v.begin(), v.end());
+        }
+        return ret;
+    }
+    for (std::size_t i = 0; ret.size() < topo.size(); ++i) {
+        for (auto &v: order) {
+            if (i < v.size()) {
+                ret.push_back(v[i]);
+            }
+        }
+    }
+    return ret;
+}
+
+namespace detail {
+    thread_placer::thread_placer(thread_affinity const &aff):
+        p_name(aff.name), p_pin(aff.placement != thread_placement::NONE)
+    {
+        if (p_pin) {
+            p_cpus = thread_cpus(aff);
+        } else if (!aff.cpus.empty()) {
+            /* validates the set */
+            thread_cpus(aff);
+            p_cpus = aff.cpus;
+        }
+    }
+} /* namespace detail */
+
+} /* namespace ostd */
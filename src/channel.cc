@@ -3,6 +3,12 @@
  * This file is part of libostd. See COPYING.md for futher information.
  */
 
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
 #include "ostd/generic_condvar.hh"
 #include "ostd/channel.hh"
 
@@ -14,6 +20,88 @@ channel_error::~channel_error() {}
 namespace detail {
     /* vtable placement for generic_condvar */
     cond_iface::~cond_iface() {}
+
+    /* spinning only makes sense when the notifier can run meanwhile */
+    static std::atomic<bool> spin_enabled{
+        std::thread::hardware_concurrency() > 1
+    };
+
+    /* a park and unpark costs a few microseconds, so spinning for much
+     * longer can't win anything even if it eventually gets woken up
+     */
+    static constexpr std::uint32_t spin_min = 250;
+    static constexpr std::uint32_t spin_max = 20000;
+
+    /* the condvar this thread last spun on in vain, and its epoch then */
+    static thread_local spin_cond const *spin_failed = nullptr;
+    static thread_local std::uint32_t spin_failed_epoch = 0;
+
+    static inline void spin_pause() noexcept {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    void spin_cond::wait(std::unique_lock<std::mutex> &l) {
+        std::uint32_t epoch = p_epoch.load();
+        if (
+            !spin_enabled.load(std::memory_order_relaxed) ||
+            ((spin_failed == this) && (spin_failed_epoch == epoch))
+        ) {
+            spin_failed = nullptr;
+            p_cond.wait(l);
+            return;
+        }
+        using sclock = std::chrono::steady_clock;
+        std::chrono::nanoseconds budget{
+            p_budget.load(std::memory_order_relaxed)
+        };
+        /* announced with the lock held, so any notifier that changes
+         * the state after we drop it is bound to see us
+         */
+        p_spinners.fetch_add(1);
+        l.unlock();
+        auto start = sclock::now();
+        std::chrono::nanoseconds waited{0};
+        bool woken = false;
+        while (!woken && (waited < budget)) {
+            /* the clock is slower to read than the epoch */
+            for (int i = 0; i < 32; ++i) {
+                if (p_epoch.load(std::memory_order_acquire) != epoch) {
+                    woken = true;
+                    break;
+                }
+                spin_pause();
+            }
+            waited = sclock::now() - start;
+        }
+        p_spinners.fetch_sub(1);
+        /* aim at twice the recent wakeup times, halve on every miss */
+        std::uint32_t ob = std::uint32_t(budget.count()), nb;
+        if (woken) {
+            nb = std::uint32_t(
+                (ob + std::min(2 * waited.count(), std::int64_t(spin_max))) / 2
+            );
+        } else {
+            nb = ob / 2;
+            spin_failed = this;
+            spin_failed_epoch = epoch;
+        }
+        p_budget.store(
+            std::clamp(nb, spin_min, spin_max), std::memory_order_relaxed
+        );
+        l.lock();
+    }
 } /* namespace detail */
 
+OSTD_EXPORT void set_condvar_spin(bool enable) noexcept {
+    detail::spin_enabled.store(enable, std::memory_order_relaxed);
+}
+
+OSTD_EXPORT bool condvar_spin() noexcept {
+    return detail::spin_enabled.load(std::memory_order_relaxed);
+}
+
 } /* namespace ostd */
@@ -3,16 +3,31 @@
  * This file is part of libostd. See COPYING.md for futher information.
  */
 
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
 #include "ostd/concurrency.hh"
 
+#ifdef __SANITIZE_ADDRESS__
+#  include <sanitizer/asan_interface.h>
+#endif
+
 namespace ostd {
 
 /* place the vtable in here */
 coroutine_error::~coroutine_error() {}
 
+/* place the vtable in here */
+task_cancelled::~task_cancelled() {}
+
 namespace detail {
     /* place the vtable in here */
     stack_free_iface::~stack_free_iface() {}
+
+    /* place the vtables in here */
+    tid_cont::~tid_cont() {}
+    tid_base::~tid_base() {}
 } /* namespace detail */
 
 /* non-inline for vtable placement */
@@ -21,12 +36,100 @@ coroutine_context::~coroutine_context() {
     free_stack();
 }
 
+void coroutine_context::make_copy(
+    detail::shared_stack *ss, void (*entry)(detail::transfer_t)
+) {
+    /* nothing to save until it has run */
+    void *p = std::malloc(sizeof(detail::stack_copy));
+    if (!p) {
+        throw std::bad_alloc{};
+    }
+    p_copy = ::new(p) detail::stack_copy{ss, entry, 0, 0};
+}
+
+void coroutine_context::free_copy() noexcept {
+    if (p_copy->stack) {
+        p_copy->stack->release(*this);
+    }
+    std::free(p_copy);
+    p_copy = nullptr;
+}
+
+namespace detail {
+    /* a little slack, so that a stack changing depth by a few frames
+     * doesn't need a new buffer every time, but a stack that used to be
+     * deep and no longer is gets its memory back
+     */
+    static constexpr std::size_t STACK_COPY_ROUND = 256;
+    static constexpr std::size_t STACK_COPY_SLACK = 4096;
+
+    void shared_stack::swap_in(coroutine_context &c) {
+        auto *top = static_cast<unsigned char *>(p_stack.ptr);
+#ifdef __SANITIZE_ADDRESS__
+        /* the redzones of the frames belong to whoever ran last, and the
+         * copies go through them, so only the heap copies are checked
+         */
+        ASAN_UNPOISON_MEMORY_REGION(top - p_stack.size, p_stack.size);
+#endif
+        /* a dead coroutine has nothing left worth saving */
+        if (p_owner && !p_owner->is_dead()) {
+            auto *&oc = p_owner->p_copy;
+            auto *sp = static_cast<unsigned char *>(p_owner->p_coro);
+            auto n = std::size_t(top - sp);
+            if ((n > oc->cap) || ((oc->cap > STACK_COPY_SLACK) && (
+                n < (oc->cap / 4)
+            ))) {
+                std::size_t cap = n + STACK_COPY_ROUND - 1;
+                cap -= cap % STACK_COPY_ROUND;
+                void *p = std::realloc(oc, sizeof(stack_copy) + cap);
+                if (!p) {
+                    throw std::bad_alloc{};
+                }
+                oc = static_cast<stack_copy *>(p);
+                oc->cap = cap;
+            }
+            std::memcpy(oc + 1, sp, n);
+            oc->size = n;
+        }
+        p_owner = nullptr;
+        auto *cc = c.p_copy;
+        if (!c.p_coro) {
+            c.p_coro = ostd_make_fcontext(top, p_stack.size, cc->entry);
+        } else {
+            std::memcpy(top - cc->size, cc + 1, cc->size);
+        }
+        p_owner = &c;
+    }
+} /* namespace detail */
+
 namespace detail {
     /* place the vtable here, derived from coroutine_context */
     csched_task::~csched_task() {}
 
     OSTD_EXPORT scheduler *current_scheduler = nullptr;
     OSTD_EXPORT thread_local csched_task *current_csched_task = nullptr;
+
+    static thread_local cancel_state *current_cancel_state = nullptr;
+
+    OSTD_EXPORT cancel_state *current_cancel() noexcept {
+        return current_cancel_state;
+    }
+
+    OSTD_EXPORT cancel_state *swap_current_cancel(cancel_state *cs) noexcept {
+        return std::exchange(current_cancel_state, cs);
+    }
+
+    OSTD_EXPORT void throw_cancelled() {
+        throw task_cancelled{};
+    }
+
+    OSTD_EXPORT void cancel_relax() noexcept {
+        if (current_csched_task) {
+            current_scheduler->yield();
+        } else {
+            std::this_thread::yield();
+        }
+    }
 } /* namespace detail */
 
 scheduler::~scheduler() {}
@@ -13,9 +13,458 @@
 #  error "Unsupported platform"
 #endif
 
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ostd/context_stack.hh"
+
+#ifdef __SANITIZE_ADDRESS__
+#  include <sanitizer/asan_interface.h>
+#endif
+
 namespace ostd {
 struct coroutine_context;
 namespace detail {
     OSTD_EXPORT thread_local coroutine_context *coro_current = nullptr;
+
+    /* stacks go between the threads and the depot in batches of this many,
+     * and a thread caches at most twice as many for every pool
+     */
+    static constexpr std::size_t STACK_BATCH = 8;
+    static constexpr std::size_t STACK_SLOTS = 64;
+    static constexpr std::size_t STACK_CACHES = 4;
+
+    /* every slot holds a whole batch, so batches are only ever swapped in
+     * and out as a whole and there is no list that could suffer from ABA;
+     * when the slots are full or empty, the lock protected spill list and
+     * the chunk allocation are the slow path
+     */
+    struct stack_depot {
+        stack_depot(std::size_t ss, std::size_t cs, unsigned int flags):
+            p_stacksize(ss), p_chunkstacks(std::max(cs, std::size_t(1))),
+            p_flags(flags)
+        {}
+
+        ~stack_depot() {
+            for (void *c: p_chunks) {
+                stack_free(c, p_stacksize * p_chunkstacks);
+            }
+        }
+
+        stack_depot_node *take_batch(std::size_t hint) {
+            for (std::size_t i = 0; i < STACK_SLOTS; ++i) {
+                auto &sl = p_slots[(hint + i) % STACK_SLOTS];
+                if (!sl.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                if (auto *b = sl.exchange(nullptr, std::memory_order_acquire)) {
+                    p_count.fetch_sub(b->count, std::memory_order_relaxed);
+                    return b;
+                }
+            }
+            stack_depot_node *ret;
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                if (p_spill) {
+                    ret = p_spill;
+                    p_spill = ret->next_batch;
+                    p_count.fetch_sub(ret->count, std::memory_order_relaxed);
+                    return ret;
+                }
+                ret = alloc_chunk();
+            }
+            /* give the other batches of the new chunk to everybody else */
+            while (auto *b = ret->next_batch) {
+                ret->next_batch = b->next_batch;
+                put_batch(b, hint);
+            }
+            return ret;
+        }
+
+        void put_batch(stack_depot_node *b, std::size_t hint) noexcept {
+            p_count.fetch_add(b->count, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < STACK_SLOTS; ++i) {
+                auto &sl = p_slots[(hint + i) % STACK_SLOTS];
+                stack_depot_node *e = nullptr;
+                if (sl.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                if (sl.compare_exchange_strong(
+                    e, b, std::memory_order_release, std::memory_order_relaxed
+                )) {
+                    return;
+                }
+            }
+            std::lock_guard<std::mutex> l{p_lock};
+            b->next_batch = p_spill;
+            p_spill = b;
+        }
+
+        void reserve(std::size_t n) {
+            std::lock_guard<std::mutex> l{p_lock};
+            while (p_capacity < n) {
+                auto *b = alloc_chunk();
+                while (b) {
+                    auto *nb = b->next_batch;
+                    p_count.fetch_add(b->count, std::memory_order_relaxed);
+                    b->next_batch = p_spill;
+                    p_spill = b;
+                    b = nb;
+                }
+            }
+        }
+
+        /* takes everything out of the depot for the time being, so that
+         * it's not going to be touched by anybody else
+         */
+        void trim(std::size_t keep, std::size_t pgs) noexcept {
+            stack_depot_node *list = nullptr;
+            for (auto &sl: p_slots) {
+                if (auto *b = sl.exchange(nullptr, std::memory_order_acquire)) {
+                    p_count.fetch_sub(b->count, std::memory_order_relaxed);
+                    b->next_batch = list;
+                    list = b;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                while (auto *b = p_spill) {
+                    p_spill = b->next_batch;
+                    p_count.fetch_sub(b->count, std::memory_order_relaxed);
+                    b->next_batch = list;
+                    list = b;
+                }
+            }
+            /* everything but the page at the top, which holds the node */
+            std::size_t rsize = (p_stacksize - sizeof(stack_depot_node));
+            rsize = rsize / pgs * pgs;
+            std::size_t n = 0;
+            for (auto *b = list; b; b = b->next_batch) {
+                if ((n >= keep) && rsize) {
+                    for (auto *nd = b; nd; nd = nd->next) {
+                        auto *top = reinterpret_cast<unsigned char *>(nd);
+                        stack_release(
+                            top + sizeof(stack_depot_node) - p_stacksize, rsize
+                        );
+                    }
+                }
+                n += b->count;
+            }
+            while (auto *b = list) {
+                list = b->next_batch;
+                put_batch(b, 0);
+            }
+        }
+
+        stack_pool_stats stats() noexcept {
+            stack_pool_stats ret;
+            std::lock_guard<std::mutex> l{p_lock};
+            std::size_t cs = p_stacksize * p_chunkstacks;
+            ret.stacks = p_capacity;
+            ret.unused = p_count.load(std::memory_order_relaxed);
+            for (void *c: p_chunks) {
+                ret.reserved += cs;
+                ret.resident += stack_resident(c, cs);
+            }
+            return ret;
+        }
+
+    private:
+        /* with the lock held; returns the batches of the chunk */
+        stack_depot_node *alloc_chunk() {
+            p_chunks.reserve(p_chunks.size() + 1);
+            auto *chunk = static_cast<unsigned char *>(
+                stack_alloc(p_stacksize * p_chunkstacks, p_flags)
+            );
+            p_chunks.push_back(chunk);
+            p_capacity += p_chunkstacks;
+            stack_depot_node *ret = nullptr;
+            for (std::size_t i = p_chunkstacks; i > 0;) {
+                std::size_t n = std::min(STACK_BATCH, i);
+                stack_depot_node *b = nullptr;
+                for (std::size_t j = 0; j < n; ++j, --i) {
+                    auto *nd = reinterpret_cast<stack_depot_node *>(
+                        chunk + p_stacksize * i - sizeof(stack_depot_node)
+                    );
+                    nd->next = b;
+                    b = nd;
+                }
+                b->count = n;
+                b->next_batch = ret;
+                ret = b;
+            }
+            return ret;
+        }
+
+        std::atomic<stack_depot_node *> p_slots[STACK_SLOTS] = {};
+        /* the stacks in the slots and the spill list */
+        std::atomic<std::size_t> p_count{0};
+        std::mutex p_lock;
+        stack_depot_node *p_spill = nullptr;
+        std::vector<void *> p_chunks;
+        std::size_t p_stacksize;
+        std::size_t p_chunkstacks;
+        std::size_t p_capacity = 0;
+        unsigned int p_flags;
+    };
+
+    /* the owner tells apart a live pool from a dead one that happened
+     * to have the same address; the stacks cached for a dead pool are
+     * simply forgotten, as its memory is gone
+     */
+    struct stack_cache_entry {
+        stack_depot *depot = nullptr;
+        std::weak_ptr<stack_depot> owner{};
+        stack_depot_node *head = nullptr;
+        std::size_t count = 0;
+    };
+
+    /* splits the list into batches and hands them over */
+    static void stack_cache_flush(
+        stack_depot &d, stack_depot_node *nd, std::size_t hint
+    ) noexcept {
+        while (nd) {
+            auto *b = nd;
+            std::size_t n = 1;
+            for (; (n < STACK_BATCH) && nd->next; ++n) {
+                nd = nd->next;
+            }
+            auto *next = nd->next;
+            nd->next = nullptr;
+            b->count = n;
+            d.put_batch(b, hint);
+            nd = next;
+        }
+    }
+
+    struct stack_cache {
+        stack_cache() {
+            static std::atomic<std::size_t> threads{0};
+            hint = threads.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ~stack_cache();
+
+        stack_cache_entry &get(
+            std::shared_ptr<stack_depot> const &d
+        ) noexcept {
+            stack_cache_entry *fe = nullptr;
+            for (auto &e: entries) {
+                if (!e.depot || e.owner.expired()) {
+                    if (!fe) {
+                        fe = &e;
+                    }
+                } else if (e.depot == d.get()) {
+                    return e;
+                }
+            }
+            if (!fe) {
+                fe = &entries[evict++ % STACK_CACHES];
+            }
+            release(*fe);
+            fe->depot = d.get();
+            fe->owner = d;
+            return *fe;
+        }
+
+        void release(stack_cache_entry &e) noexcept {
+            if (auto d = e.owner.lock()) {
+                stack_cache_flush(*d, e.head, hint);
+            }
+            e = stack_cache_entry{};
+        }
+
+        stack_cache_entry entries[STACK_CACHES];
+        std::size_t evict = 0;
+        std::size_t hint;
+    };
+
+    /* only ever used from here, as tasks may move between threads; once
+     * the cache is gone, stacks go straight to and from the depot
+     */
+    static thread_local stack_cache stack_tcache;
+    static thread_local bool stack_tcache_dead = false;
+
+    stack_cache::~stack_cache() {
+        stack_tcache_dead = true;
+        for (auto &e: entries) {
+            release(e);
+        }
+    }
+
+    OSTD_EXPORT std::shared_ptr<stack_depot> stack_depot_new(
+        std::size_t ss, std::size_t cs, unsigned int flags
+    ) {
+        return std::make_shared<stack_depot>(ss, cs, flags);
+    }
+
+    OSTD_EXPORT stack_depot_node *stack_depot_take(
+        std::shared_ptr<stack_depot> const &d
+    ) {
+        if (stack_tcache_dead) {
+            auto *b = d->take_batch(0);
+            if (b->next) {
+                b->next->count = b->count - 1;
+                d->put_batch(b->next, 0);
+            }
+            return b;
+        }
+        auto &c = stack_tcache;
+        auto &e = c.get(d);
+        if (!e.head) {
+            e.head = d->take_batch(c.hint);
+            e.count = e.head->count;
+        }
+        auto *ret = e.head;
+        e.head = ret->next;
+        --e.count;
+        return ret;
+    }
+
+    OSTD_EXPORT void stack_depot_put(
+        std::shared_ptr<stack_depot> const &d, stack_depot_node *nd
+    ) noexcept {
+        if (stack_tcache_dead) {
+            nd->next = nullptr;
+            nd->count = 1;
+            d->put_batch(nd, 0);
+            return;
+        }
+        auto &c = stack_tcache;
+        auto &e = c.get(d);
+        nd->next = e.head;
+        e.head = nd;
+        if (++e.count < (2 * STACK_BATCH)) {
+            return;
+        }
+        /* keep the most recently used half, they're likely still warm */
+        auto *last = nd;
+        for (std::size_t i = 1; i < STACK_BATCH; ++i) {
+            last = last->next;
+        }
+        auto *b = last->next;
+        last->next = nullptr;
+        e.count = STACK_BATCH;
+        stack_cache_flush(*d, b, c.hint);
+    }
+
+    OSTD_EXPORT void stack_depot_reserve(
+        std::shared_ptr<stack_depot> const &d, std::size_t n
+    ) {
+        d->reserve(n);
+    }
+
+    OSTD_EXPORT void stack_depot_trim(
+        std::shared_ptr<stack_depot> const &d, std::size_t keep,
+        std::size_t pgs
+    ) noexcept {
+        d->trim(keep, pgs);
+    }
+
+    OSTD_EXPORT stack_pool_stats stack_depot_stats(
+        std::shared_ptr<stack_depot> const &d
+    ) noexcept {
+        return d->stats();
+    }
+
+    /* unlikely to be found on a stack by chance */
+    static constexpr std::uint64_t STACK_PATTERN = 0x5AC4F111EDC0FFEEULL;
+
+    template<typename F>
+    static void stack_words(
+        stack_context const &st, std::size_t skip, F &&func
+    ) noexcept {
+        if (skip >= st.size) {
+            return;
+        }
+        auto *top = static_cast<unsigned char *>(st.ptr);
+        auto *p = reinterpret_cast<std::uint64_t *>(top - st.size + skip);
+        auto *e = reinterpret_cast<std::uint64_t *>(top);
+#ifdef __SANITIZE_ADDRESS__
+        /* frames that were switched away from leave their redzones
+         * poisoned, and the whole stack is ours to fill and scan
+         */
+        ASAN_UNPOISON_MEMORY_REGION(p, st.size - skip);
+#endif
+        func(p, e);
+    }
 } /* namespace detail */
+
+struct stack_profiler::state {
+    std::atomic<std::uint64_t> stacks{0};
+    std::atomic<std::size_t> size{0};
+    std::atomic<std::size_t> max{0};
+    std::atomic<std::uint64_t> counts[stack_profile::BUCKETS] = {};
+};
+
+stack_profiler::stack_profiler(): p_state{std::make_shared<state>()} {}
+
+stack_profile stack_profiler::get() const noexcept {
+    stack_profile ret;
+    ret.stacks = p_state->stacks.load(std::memory_order_relaxed);
+    ret.size = p_state->size.load(std::memory_order_relaxed);
+    ret.max = p_state->max.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < stack_profile::BUCKETS; ++i) {
+        ret.counts[i] = p_state->counts[i].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+void stack_profiler::reset() noexcept {
+    p_state->stacks.store(0, std::memory_order_relaxed);
+    p_state->size.store(0, std::memory_order_relaxed);
+    p_state->max.store(0, std::memory_order_relaxed);
+    for (auto &c: p_state->counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+void stack_profiler::fill(
+    stack_context const &st, std::size_t skip
+) const noexcept {
+    detail::stack_words(st, skip, [](std::uint64_t *p, std::uint64_t *e) {
+        std::fill(p, e, detail::STACK_PATTERN);
+    });
+}
+
+void stack_profiler::measure(
+    stack_context const &st, std::size_t skip
+) const noexcept {
+    std::size_t depth = 0;
+    detail::stack_words(st, skip, [&st, &depth](
+        std::uint64_t *p, std::uint64_t *e
+    ) {
+        /* the stack grows down, so the first changed word is the deepest */
+        auto *d = std::find_if(p, e, [](std::uint64_t w) {
+            return w != detail::STACK_PATTERN;
+        });
+        if (d == p) {
+            depth = st.size;
+        } else {
+            depth = std::size_t(
+                reinterpret_cast<unsigned char *>(e) -
+                reinterpret_cast<unsigned char *>(d)
+            );
+        }
+    });
+    auto upd = [](std::atomic<std::size_t> &v, std::size_t n) {
+        std::size_t o = v.load(std::memory_order_relaxed);
+        while ((o < n) && !v.compare_exchange_weak(
+            o, n, std::memory_order_relaxed
+        )) {}
+    };
+    upd(p_state->size, st.size);
+    upd(p_state->max, depth);
+    std::size_t b = 0;
+    for (std::size_t d = depth; d && (b < (stack_profile::BUCKETS - 1)); ++b) {
+        d >>= 1;
+    }
+    p_state->counts[b].fetch_add(1, std::memory_order_relaxed);
+    p_state->stacks.fetch_add(1, std::memory_order_relaxed);
+}
 } /* namespace ostd */
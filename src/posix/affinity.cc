@@ -0,0 +1,153 @@
+/* CPU topology and thread placement bits.
+ * For Linux systems only (using sysfs and sched_setaffinity), other
+ * implementations are stored elsewhere.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include "ostd/platform.hh"
+
+#ifndef OSTD_PLATFORM_LINUX
+#  error "Incorrect platform"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "ostd/affinity.hh"
+
+namespace ostd {
+
+namespace detail {
+    /* reads the first line of a sysfs file, false if there is none */
+    static bool sysfs_read(std::string const &path, std::string &ret) {
+        FILE *f = std::fopen(path.c_str(), "r");
+        if (!f) {
+            return false;
+        }
+        char buf[256];
+        bool ok = std::fgets(buf, sizeof(buf), f);
+        std::fclose(f);
+        if (!ok) {
+            return false;
+        }
+        ret = buf;
+        while (!ret.empty() && ((ret.back() == '\n') || (ret.back() == ' '))) {
+            ret.pop_back();
+        }
+        return true;
+    }
+
+    /* the lowest CPU of a list like 0-3,8-11 is always the first one */
+    static bool sysfs_first(std::string const &path, unsigned int &ret) {
+        std::string s;
+        if (!sysfs_read(path, s) || s.empty()) {
+            return false;
+        }
+        char *end;
+        unsigned long v = std::strtoul(s.c_str(), &end, 10);
+        if (end == s.c_str()) {
+            return false;
+        }
+        ret = static_cast<unsigned int>(v);
+        return true;
+    }
+
+    /* the domain of the highest cache level shared by the CPU */
+    static bool sysfs_cache(std::string const &cpath, unsigned int &ret) {
+        unsigned int level = 0;
+        bool found = false;
+        for (unsigned int i = 0;; ++i) {
+            std::string ipath = cpath + "/cache/index" + std::to_string(i);
+            std::string type;
+            unsigned int l;
+            if (!sysfs_first(ipath + "/level", l)) {
+                break;
+            }
+            if (
+                !sysfs_read(ipath + "/type", type) ||
+                (type == "Instruction") || (l < level)
+            ) {
+                continue;
+            }
+            unsigned int first;
+            if (sysfs_first(ipath + "/shared_cpu_list", first)) {
+                level = l;
+                ret = first;
+                found = true;
+            }
+        }
+        return found;
+    }
+} /* namespace detail */
+
+OSTD_EXPORT std::vector<cpu_info> cpu_topology() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        throw std::system_error{errno, std::generic_category()};
+    }
+    std::vector<cpu_info> ret;
+    std::vector<bool> nocache;
+    for (unsigned int i = 0; i < CPU_SETSIZE; ++i) {
+        if (!CPU_ISSET(i, &set)) {
+            continue;
+        }
+        std::string cpath = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+        cpu_info c{i, i, 0, i};
+        detail::sysfs_first(cpath + "/topology/thread_siblings_list", c.core);
+        detail::sysfs_first(
+            cpath + "/topology/physical_package_id", c.package
+        );
+        nocache.push_back(!detail::sysfs_cache(cpath, c.cache));
+        ret.push_back(c);
+    }
+    /* without cache information, the package is the best guess */
+    for (std::size_t i = 0; i < ret.size(); ++i) {
+        if (!nocache[i]) {
+            continue;
+        }
+        for (auto &c: ret) {
+            if (c.package == ret[i].package) {
+                ret[i].cache = c.id;
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
+namespace detail {
+    void thread_placer::apply(std::size_t idx) const noexcept {
+        /* failures are not fatal, the thread runs unplaced or unnamed */
+        if (!p_cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (p_pin) {
+                CPU_SET(p_cpus[idx % p_cpus.size()], &set);
+            } else {
+                for (auto id: p_cpus) {
+                    CPU_SET(id, &set);
+                }
+            }
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        if (!p_name.empty()) {
+            /* the kernel limit is 15 characters, keep the index */
+            std::string sfx = "-" + std::to_string(idx);
+            std::string name = p_name.substr(
+                0, (sfx.size() < 15) ? (15 - sfx.size()) : 0
+            ) + sfx;
+            pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        }
+    }
+} /* namespace detail */
+
+} /* namespace ostd */
@@ -11,9 +11,12 @@
 #endif
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstdio>
 #include <new>
 #include <mutex>
+#include <algorithm>
 
 #include "ostd/context_stack.hh"
 
@@ -37,11 +40,92 @@ namespace detail {
     constexpr bool CONTEXT_USE_MMAP = false;
 #endif
 
-    OSTD_EXPORT void *stack_alloc(std::size_t sz) {
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+    inline void ctx_hugepagesize(std::size_t *s) noexcept {
+        /* the usual size on most platforms if we can't find out */
+        *s = 2 * 1024 * 1024;
+        FILE *f = std::fopen(
+            "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r"
+        );
+        if (!f) {
+            return;
+        }
+        unsigned long v;
+        if ((std::fscanf(f, "%lu", &v) == 1) && v) {
+            *s = std::size_t(v);
+        }
+        std::fclose(f);
+    }
+
+    /* null on failure, so that the normal way can be tried */
+    static void *stack_alloc_huge(
+        std::size_t sz, int mflags, unsigned int flags
+    ) noexcept {
+        static std::size_t hps = 0;
+        static std::once_flag fl;
+        std::call_once(fl, ctx_hugepagesize, &hps);
+        if (sz < hps) {
+            return nullptr;
+        }
+#ifdef MAP_HUGETLB
+        /* only works if the system has some reserved for us */
+        if (!(sz % hps) && !(flags & STACK_PROTECTED)) {
+            void *p = mmap(
+                nullptr, sz, PROT_READ | PROT_WRITE, mflags | MAP_HUGETLB,
+                -1, 0
+            );
+            if (p != MAP_FAILED) {
+                return p;
+            }
+        }
+#else
+        (void)flags;
+#endif
+#ifdef MADV_HUGEPAGE
+        /* transparent huge pages need the memory to be aligned to them,
+         * so map some more and cut off what's left over on either side
+         */
+        void *p = mmap(
+            nullptr, sz + hps, PROT_READ | PROT_WRITE, mflags, -1, 0
+        );
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        auto *bp = static_cast<unsigned char *>(p);
+        auto *ap = reinterpret_cast<unsigned char *>(
+            (reinterpret_cast<std::uintptr_t>(bp) + hps - 1) & ~(hps - 1)
+        );
+        if (ap != bp) {
+            munmap(bp, std::size_t(ap - bp));
+        }
+        if (std::size_t tail = std::size_t(bp + hps - ap); tail) {
+            munmap(ap + sz, tail);
+        }
+        madvise(ap, sz, MADV_HUGEPAGE);
+        return ap;
+#else
+        return nullptr;
+#endif
+    }
+#endif
+
+    OSTD_EXPORT void *stack_alloc(std::size_t sz, unsigned int flags) {
         if constexpr(CONTEXT_USE_MMAP) {
+            int mflags = MAP_PRIVATE | CONTEXT_MAP_ANON;
+#ifdef MAP_NORESERVE
+            if (flags & STACK_NO_RESERVE) {
+                mflags |= MAP_NORESERVE;
+            }
+#endif
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+            if (flags & STACK_HUGE_PAGES) {
+                if (void *p = stack_alloc_huge(sz, mflags, flags); p) {
+                    return p;
+                }
+            }
+#endif
             void *p = mmap(
-                nullptr, sz, PROT_READ | PROT_WRITE,
-                MAP_PRIVATE | CONTEXT_MAP_ANON, -1, 0
+                nullptr, sz, PROT_READ | PROT_WRITE, mflags, -1, 0
             );
             if (p == MAP_FAILED) {
                 throw std::bad_alloc{};
@@ -73,6 +157,45 @@ namespace detail {
         mprotect(p, sz, PROT_NONE);
     }
 
+    OSTD_EXPORT void stack_release(void *p, std::size_t sz) noexcept {
+#ifdef MADV_DONTNEED
+        if constexpr(CONTEXT_USE_MMAP) {
+            /* the pages read back as zeroes the next time around */
+            madvise(p, sz, MADV_DONTNEED);
+        }
+#endif
+    }
+
+#ifdef OSTD_PLATFORM_LINUX
+    using mincore_vec = unsigned char;
+#else
+    using mincore_vec = char;
+#endif
+
+    OSTD_EXPORT std::size_t stack_resident(void *p, std::size_t sz) noexcept {
+        if constexpr(!CONTEXT_USE_MMAP) {
+            return sz;
+        }
+        std::size_t pgs = std::size_t(sysconf(_SC_PAGESIZE));
+        std::size_t ret = 0;
+        mincore_vec vec[256];
+        auto *cp = static_cast<char *>(p);
+        for (std::size_t off = 0; off < sz;) {
+            std::size_t len = std::min(sz - off, sizeof(vec) * pgs);
+            if (mincore(cp + off, len, vec) < 0) {
+                /* can't tell, so count it all */
+                return sz;
+            }
+            for (std::size_t i = 0; i < (len + pgs - 1) / pgs; ++i) {
+                if (vec[i] & 1) {
+                    ret += pgs;
+                }
+            }
+            off += len;
+        }
+        return std::min(ret, sz);
+    }
+
     /* used by stack traits */
     inline void ctx_pagesize(std::size_t *s) noexcept {
         *s = std::size_t(sysconf(_SC_PAGESIZE));
@@ -0,0 +1,346 @@
+/* I/O reactor implementation bits.
+ * For Linux systems only (using epoll), other implementations are stored
+ * elsewhere.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include "ostd/platform.hh"
+
+#ifndef OSTD_PLATFORM_LINUX
+#  error "Incorrect platform"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "ostd/reactor.hh"
+#include "ostd/concurrency.hh"
+
+namespace ostd {
+
+namespace detail {
+    /* the readiness flags are set by the reactor thread and consumed by
+     * the waiters; as the descriptors are edge triggered, a flag that is
+     * set means something may have happened since the last wait
+     */
+    struct reactor_fd {
+        template<typename F>
+        reactor_fd(F &func, int fl): p_rcond(func()), p_wcond(func()),
+            p_flags(fl)
+        {}
+
+        void signal(bool r, bool w) {
+            {
+                std::lock_guard<std::mutex> l{p_lock};
+                p_readable = p_readable || r;
+                p_writable = p_writable || w;
+            }
+            if (r) {
+                p_rcond.notify_all();
+            }
+            if (w) {
+                p_wcond.notify_all();
+            }
+        }
+
+        void wait(bool r) {
+            std::unique_lock<std::mutex> l{p_lock};
+            bool &ready = r ? p_readable : p_writable;
+            generic_condvar &cond = r ? p_rcond : p_wcond;
+            while (!ready) {
+                cond.wait(l);
+            }
+            ready = false;
+        }
+
+        std::mutex p_lock;
+        generic_condvar p_rcond, p_wcond;
+        int p_flags;
+        bool p_readable = false, p_writable = false;
+    };
+
+    [[noreturn]] static void reactor_throw() {
+        throw reactor_error{errno, std::generic_category()};
+    }
+
+    /* errno is thread local and a task may be resumed on another thread
+     * after waiting, while the compiler is free to keep the address of
+     * errno around for the whole function; so the calls which need to
+     * check it are kept out of line and return the error instead
+     */
+    __attribute__((noinline)) static int reactor_errno(ssize_t ret) {
+        return (ret < 0) ? errno : 0;
+    }
+
+    __attribute__((noinline)) static ssize_t reactor_read(
+        int fd, void *buf, std::size_t count, int &err
+    ) {
+        auto ret = ::read(fd, buf, count);
+        err = reactor_errno(ret);
+        return ret;
+    }
+
+    __attribute__((noinline)) static ssize_t reactor_write(
+        int fd, void const *buf, std::size_t count, int &err
+    ) {
+        auto ret = ::write(fd, buf, count);
+        err = reactor_errno(ret);
+        return ret;
+    }
+
+    __attribute__((noinline)) static std::size_t reactor_fread(
+        FILE *fp, void *buf, std::size_t count, int &err
+    ) {
+        errno = 0;
+        auto ret = std::fread(buf, 1, count, fp);
+        err = std::ferror(fp) ? errno : 0;
+        return ret;
+    }
+
+    static bool reactor_again(int err) {
+        return (err == EAGAIN) || (err == EWOULDBLOCK);
+    }
+} /* namespace detail */
+
+struct reactor::impl {
+    impl() {
+        p_epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (p_epfd < 0) {
+            detail::reactor_throw();
+        }
+        p_evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (p_evfd < 0) {
+            int err = errno;
+            ::close(p_epfd);
+            throw reactor_error{err, std::generic_category()};
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = p_evfd;
+        if (epoll_ctl(p_epfd, EPOLL_CTL_ADD, p_evfd, &ev) < 0) {
+            int err = errno;
+            ::close(p_evfd);
+            ::close(p_epfd);
+            throw reactor_error{err, std::generic_category()};
+        }
+        p_thread = std::thread{[this]() {
+            run();
+        }};
+    }
+
+    ~impl() {
+        std::uint64_t v = 1;
+        while ((::write(p_evfd, &v, sizeof(v)) < 0) && (errno == EINTR)) {}
+        p_thread.join();
+        ::close(p_evfd);
+        ::close(p_epfd);
+    }
+
+    void add(int fd) {
+        int fl = fcntl(fd, F_GETFL);
+        if (fl < 0) {
+            detail::reactor_throw();
+        }
+        auto mkcond = []() {
+            if (detail::current_scheduler) {
+                return detail::current_scheduler->make_condition();
+            }
+            return generic_condvar{};
+        };
+        auto st = std::make_shared<detail::reactor_fd>(mkcond, fl);
+        {
+            std::lock_guard<std::mutex> l{p_lock};
+            if (!p_fds.emplace(fd, st).second) {
+                return;
+            }
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        if (
+            (fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) ||
+            (epoll_ctl(p_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        ) {
+            int err = errno;
+            fcntl(fd, F_SETFL, fl);
+            std::lock_guard<std::mutex> l{p_lock};
+            p_fds.erase(fd);
+            throw reactor_error{err, std::generic_category()};
+        }
+    }
+
+    void remove(int fd) noexcept {
+        std::shared_ptr<detail::reactor_fd> st;
+        {
+            std::lock_guard<std::mutex> l{p_lock};
+            auto it = p_fds.find(fd);
+            if (it == p_fds.end()) {
+                return;
+            }
+            st = std::move(it->second);
+            p_fds.erase(it);
+        }
+        epoll_ctl(p_epfd, EPOLL_CTL_DEL, fd, nullptr);
+        fcntl(fd, F_SETFL, st->p_flags);
+    }
+
+    void wait(int fd, bool r) {
+        std::shared_ptr<detail::reactor_fd> st;
+        {
+            std::lock_guard<std::mutex> l{p_lock};
+            auto it = p_fds.find(fd);
+            if (it == p_fds.end()) {
+                throw reactor_error{EBADF, std::generic_category()};
+            }
+            st = it->second;
+        }
+        st->wait(r);
+    }
+
+private:
+    void run() {
+        epoll_event evs[64];
+        for (;;) {
+            int n = epoll_wait(p_epfd, evs, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                int fd = evs[i].data.fd;
+                if (fd == p_evfd) {
+                    return;
+                }
+                std::shared_ptr<detail::reactor_fd> st;
+                {
+                    std::lock_guard<std::mutex> l{p_lock};
+                    auto it = p_fds.find(fd);
+                    if (it == p_fds.end()) {
+                        continue;
+                    }
+                    st = it->second;
+                }
+                /* errors and hangups wake up everybody, the following
+                 * read or write will then report them
+                 */
+                auto e = evs[i].events;
+                auto any = EPOLLERR | EPOLLHUP;
+                st->signal(
+                    e & (EPOLLIN | EPOLLRDHUP | any), e & (EPOLLOUT | any)
+                );
+            }
+        }
+    }
+
+    std::mutex p_lock;
+    std::unordered_map<int, std::shared_ptr<detail::reactor_fd>> p_fds;
+    std::thread p_thread;
+    int p_epfd = -1, p_evfd = -1;
+};
+
+reactor::reactor(): p_impl{std::make_unique<impl>()} {}
+
+reactor::~reactor() {}
+
+void reactor::add(int fd) {
+    p_impl->add(fd);
+}
+
+void reactor::add(file_stream &f) {
+    std::fflush(f.get_file());
+    p_impl->add(fileno(f.get_file()));
+}
+
+void reactor::remove(int fd) noexcept {
+    p_impl->remove(fd);
+}
+
+void reactor::remove(file_stream &f) noexcept {
+    p_impl->remove(fileno(f.get_file()));
+}
+
+void reactor::wait_readable(int fd) {
+    p_impl->wait(fd, true);
+}
+
+void reactor::wait_writable(int fd) {
+    p_impl->wait(fd, false);
+}
+
+std::size_t reactor::read(int fd, void *buf, std::size_t count) {
+    for (int err;;) {
+        auto n = detail::reactor_read(fd, buf, count, err);
+        if (n >= 0) {
+            return std::size_t(n);
+        }
+        if (detail::reactor_again(err)) {
+            wait_readable(fd);
+        } else if (err != EINTR) {
+            throw reactor_error{err, std::generic_category()};
+        }
+    }
+}
+
+void reactor::write(int fd, void const *buf, std::size_t count) {
+    auto *p = static_cast<unsigned char const *>(buf);
+    for (int err; count;) {
+        auto n = detail::reactor_write(fd, p, count, err);
+        if (n >= 0) {
+            p += n;
+            count -= std::size_t(n);
+        } else if (detail::reactor_again(err)) {
+            wait_writable(fd);
+        } else if (err != EINTR) {
+            throw reactor_error{err, std::generic_category()};
+        }
+    }
+}
+
+std::size_t reactor::read(file_stream &f, void *buf, std::size_t count) {
+    FILE *fp = f.get_file();
+    auto *p = static_cast<unsigned char *>(buf);
+    std::size_t readn = 0;
+    for (int err; readn < count;) {
+        /* a would-be-blocking read sets the error flag, but anything
+         * read up until that point is still returned and buffered
+         */
+        readn += detail::reactor_fread(fp, p + readn, count - readn, err);
+        if ((readn == count) || std::feof(fp)) {
+            break;
+        }
+        if (!detail::reactor_again(err) && (err != EINTR)) {
+            throw stream_error{EIO, std::generic_category()};
+        }
+        std::clearerr(fp);
+        if (err != EINTR) {
+            wait_readable(fileno(fp));
+        }
+    }
+    return readn;
+}
+
+void reactor::write(file_stream &f, void const *buf, std::size_t count) {
+    FILE *fp = f.get_file();
+    try {
+        write(fileno(fp), buf, count);
+    } catch (reactor_error const &) {
+        throw stream_error{EIO, std::generic_category()};
+    }
+}
+
+} /* namespace ostd */
@@ -0,0 +1,55 @@
+/* Decides between the reactor implementations.
+ *
+ * This file is part of libostd. See COPYING.md for futher information.
+ */
+
+#include <cerrno>
+#include <system_error>
+
+#include "ostd/platform.hh"
+#include "ostd/reactor.hh"
+
+#if defined(OSTD_PLATFORM_LINUX)
+#  include "src/posix/reactor.cc"
+#else
+
+namespace ostd {
+
+/* no implementation for this platform yet */
+struct reactor::impl {};
+
+reactor::reactor() {
+    throw reactor_error{ENOSYS, std::generic_category()};
+}
+
+reactor::~reactor() {}
+
+void reactor::add(int) {}
+void reactor::add(file_stream &) {}
+void reactor::remove(int) noexcept {}
+void reactor::remove(file_stream &) noexcept {}
+void reactor::wait_readable(int) {}
+void reactor::wait_writable(int) {}
+
+std::size_t reactor::read(int, void *, std::size_t) {
+    return 0;
+}
+
+void reactor::write(int, void const *, std::size_t) {}
+
+std::size_t reactor::read(file_stream &, void *, std::size_t) {
+    return 0;
+}
+
+void reactor::write(file_stream &, void const *, std::size_t) {}
+
+} /* namespace ostd */
+
+#endif
+
+namespace ostd {
+
+/* place the vtable in here */
+reactor_error::~reactor_error() {}
+
+} /* namespace ostd */
@@ -12,5 +12,7 @@ namespace detail {
 /* place the vtable here */
 tpool_func_base::~tpool_func_base() {}
 
+OSTD_EXPORT thread_local tpool_worker *current_tpool_worker = nullptr;
+
 } /* namespace detail */
 } /* namespace ostd */
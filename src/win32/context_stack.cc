@@ -23,7 +23,8 @@
 namespace ostd {
 
 namespace detail {
-    OSTD_EXPORT void *stack_alloc(std::size_t sz) {
+    /* large pages need a privilege and everything is committed anyway */
+    OSTD_EXPORT void *stack_alloc(std::size_t sz, unsigned int) {
         void *p = VirtualAlloc(0, sz, MEM_COMMIT, PAGE_READWRITE);
         if (!p) {
             throw std::bad_alloc{};
@@ -44,6 +45,16 @@ namespace detail {
         VirtualProtect(p, sz, PAGE_READWRITE | PAGE_GUARD, &oo);
     }
 
+    OSTD_EXPORT void stack_release(void *p, std::size_t sz) noexcept {
+        /* the pages stay committed, but their contents may be discarded */
+        VirtualAlloc(p, sz, MEM_RESET, PAGE_READWRITE);
+    }
+
+    OSTD_EXPORT std::size_t stack_resident(void *, std::size_t sz) noexcept {
+        /* no cheap way to tell, count everything */
+        return sz;
+    }
+
     /* used by stack traits */
     inline void ctx_pagesize(std::size_t *s) noexcept {
         SYSTEM_INFO si;